@@ -0,0 +1,34 @@
+/* Generated by pedometer --compile-model from motion_model.txt, do not edit */
+
+#ifndef __MOTION_MODEL_H__
+#define __MOTION_MODEL_H__
+
+#define MODEL_NUM_TREES     ( 1 )
+#define MODEL_DEPTH         ( 3 )
+#define MODEL_NUM_NODES     ( (1 << MODEL_DEPTH) - 1 )
+
+/* Feature index of each decision node */
+static const unsigned char ModelFeature[MODEL_NUM_TREES][MODEL_NUM_NODES] = {
+    { 0, 1, 0, 0, 0, 1, 1 },
+};
+
+/* Threshold of each decision node, go right if x[feature] > threshold */
+static const float ModelThreshold[MODEL_NUM_TREES][MODEL_NUM_NODES] = {
+    { 5.0f, 0.5f, 14.999999f, INFINITY, INFINITY, 2.19999981f, 2.19999981f },
+};
+
+/* Class scores (STATIC, WALK, HOP, RUN) of each leaf */
+static const float ModelLeaf[MODEL_NUM_TREES][MODEL_NUM_NODES + 1][NUM_TYPES] = {
+    {
+        { 1.0f, 0.0f, 0.0f, 0.0f },
+        { 1.0f, 0.0f, 0.0f, 0.0f },
+        { 0.0f, 1.0f, 0.0f, 0.0f },
+        { 0.0f, 1.0f, 0.0f, 0.0f },
+        { 0.0f, 1.0f, 0.0f, 0.0f },
+        { 0.0f, 0.0f, 0.0f, 1.0f },
+        { 0.0f, 0.0f, 1.0f, 0.0f },
+        { 0.0f, 0.0f, 0.0f, 1.0f },
+    },
+};
+
+#endif /* __MOTION_MODEL_H__ */
@@ -55,396 +55,6453 @@
 */
 
 
-#include "main.h"
+#include "pedometer.h"
+#include "motion_model.h"
 
 
-/* Low pass filter for smoothening sensor input data */
-static filter_t    lp_filter_x, lp_filter_y, lp_filter_z;
-static filter_t    ll_filter_x, ll_filter_y, ll_filter_z;
+/* Higher order low pass or band pass filter (--filter), copied to every instance */
+static sos_filter_t SosFilterY;
 
-/* Algo output data */
-static algo_out_t  step_algo_output;
+/* Algo configuration (thresholds) */
+static const algo_cfg_t algo_cfg_default = {
+    SMALL_AMP, LARGE_AMP, SLOW_FREQ, FAST_FREQ, NO_DETECT_DUR_SEC, CLOSE_TO_ZERO, MAX_TIME_PERIOD_SEC,
+    GYRO_MIN_ENERGY, GYRO_MAX_ENERGY
+};
 
-/* Sensor input data buffer for algo processing */
-static float       AccBuff[NUM_DIM+1][SAMP_BUFF_LEN];
+/* Algo state and output data of the sensor stream */
+static step_algo_t step_algo;
 
-/* Number of steps during Walk, Run, and Hop motions */
-static unsigned int num_steps_walk, num_steps_run, num_steps_hop;
+#if defined(STEP_ALGO_OPCOUNT)
+/* Operations executed per algorithm stage, see --energy */
+static unsigned long long OpCount[NUM_OPS_STAGES][NUM_OPS_TYPES];
+#endif
+
+/* Input channel fed to the algorithm */
+static input_mode_t InputMode = INPUT_ACC_Y;
+
+/* Gyro step validation, filtered gyro energy is saved along with the Acc Data */
+static unsigned int GyroValidate = 0;
+
+/* Per block feature extraction, feature export file and DFT tables */
+static FILE        *FeatFile = NULL;
+#if !defined(STEP_ALGO_MIN_RAM)
+static unsigned int UseModel = 0;   /* classify with the compiled model */
+static float       SpecCos[NUM_SPEC_BINS][SAMP_BUFF_LEN];
+static float       SpecSin[NUM_SPEC_BINS][SAMP_BUFF_LEN];
+static pthread_once_t SpecTablesOnce = PTHREAD_ONCE_INIT;
+#endif
+
+/* SIMD kernel variants, scalar reference first, then in order of preference.  */
+/* The AVX2 variant keeps the block features on SSE2, the bit-exact mode on    */
+/* the scalar code (the SIMD sums are reassociated).                           */
+#if defined(STEP_ALGO_MIN_RAM)
+#define SIMD_FEATURES(f)
+#elif defined(STEP_ALGO_FAST_MATH)
+#define SIMD_FEATURES(f)    , f
+#else
+#define SIMD_FEATURES(f)    , extract_axis_features_scalar
+#endif
+static const simd_kernels_t SimdVariants[] = {
+    { "scalar", step_algo_find_zc_scalar, acc_magnitude_scalar SIMD_FEATURES(extract_axis_features_scalar) },
+#if defined(__SSE2__)
+    { "sse2", step_algo_find_zc_sse2, acc_magnitude_sse2 SIMD_FEATURES(extract_axis_features_sse2) },
+#endif
+#if defined(STEP_ALGO_AVX2)
+    { "avx2", step_algo_find_zc_avx2, acc_magnitude_avx2 SIMD_FEATURES(extract_axis_features_sse2) },
+#endif
+};
+#define NUM_SIMD_VARIANTS   ( sizeof(SimdVariants) / sizeof(SimdVariants[0]) )
+
+/* Selected SIMD kernels, the variant the build targets until simd_select() */
+#if defined(__SSE2__)
+static const simd_kernels_t *SimdKernels = &SimdVariants[1];
+#else
+static const simd_kernels_t *SimdKernels = &SimdVariants[0];
+#endif
+
+/* NUMA topology and worker placement of the batch and load modes (--numa) */
+static numa_topo_t NumaTopo;
+static unsigned int NumaPlace = 1;
 
 /* Main entry point */
 int main(int argc, char *argv[])
 {
-#define MAX_CHAR_PER_LINE     (120)
-
     FILE          *fpin, *fpout;
-    unsigned int  rec_id = 0, sen_id = 0;
-    char          date[12] = { 0 }, time[12] = { 0 };
-    float         arx = 0.0f, ary = 0.0f, arz = 0.0f; /* m/s^2 */
-    float         grx = 0.0f, gry = 0.0f, grz = 0.0f; /* rad/s */
+    sens_data_t   sens_data;
     float         timestamp = 0.0f; /* sec */
-    char          line_buff[MAX_CHAR_PER_LINE] = { 0 };
-    unsigned int  skip_lines = 2;
     unsigned int  run_step_algo = 0;
-    unsigned int  timeconst_samp = 0;
-    char          *step_type;
+    unsigned int  streaming = 0;
+    const char    *simd = "auto";
+    unsigned int  v;
 
-    if( argc != 3) {
-        printf("Usage: %s inputfile outputfile\n", argv[0]);
+    /* Preprocessing options, apply to all modes */
+    while( argc > 1 ) {
+        if ((strcmp(argv[1], "--filter") == 0) && (argc > 2)) {
+            if (parse_filter_opt(argv[2], &SosFilterY) != 0) {
+                printf("Invalid filter: %s (lp:order:cutoff or bp:order:low:high, Hz)\n", argv[2]);
+                exit(1);
+            }
+            argc--;
+            argv++;
+        }
+        else if ((strcmp(argv[1], "--simd") == 0) && (argc > 2)) {
+            simd = argv[2];
+            argc--;
+            argv++;
+        }
+        else if ((strcmp(argv[1], "--numa") == 0) && (argc > 2)) {
+            if ((strcmp(argv[2], "on") != 0) && (strcmp(argv[2], "off") != 0)) {
+                printf("Invalid NUMA placement: %s (on or off)\n", argv[2]);
+                exit(1);
+            }
+            NumaPlace = (strcmp(argv[2], "on") == 0) ? 1 : 0;
+            argc--;
+            argv++;
+        }
+#if defined(STEP_ALGO_MIN_RAM)
+        else if ((strcmp(argv[1], "--magnitude") == 0) || (strcmp(argv[1], "--gyro") == 0) ||
+                 (strcmp(argv[1], "--model") == 0) || (strcmp(argv[1], "--features") == 0)) {
+            printf("%s is not available in the minimal RAM build\n", argv[1]);
+            exit(1);
+        }
+#else
+        else if (strcmp(argv[1], "--magnitude") == 0)
+            InputMode = INPUT_ACC_MAG;
+        else if (strcmp(argv[1], "--gyro") == 0)
+            GyroValidate = 1;
+        else if (strcmp(argv[1], "--model") == 0)
+            UseModel = 1;
+        else if ((strcmp(argv[1], "--features") == 0) && (argc > 2)) {
+            FeatFile = fopen(argv[2], "wb");
+            if (FeatFile == NULL) {
+                printf("Cannot open feature file: %s\n", argv[2]);
+                exit(1);
+            }
+            write_feat_header(FeatFile);
+            step_algo.feat_sink = write_feat_record;
+            step_algo.feat_arg = FeatFile;
+            argc--;
+            argv++;
+        }
+#endif
+        else
+            break;
+        argc--;
+        argv++;
+    }
+
+    /* Select the SIMD kernels once, before any algorithm instance runs */
+    if (simd_select(simd) != 0) {
+        printf("SIMD kernels not available on this CPU or build: %s (auto", simd);
+        for (v = 0; v < NUM_SIMD_VARIANTS; v++)
+            printf(", %s", SimdVariants[v].name);
+        printf(")\n");
         exit(1);
     }
+    numa_init(&NumaTopo);
+
+    if( (argc > 1) && (strcmp(argv[1], "--sweep") == 0) ) {
+        exit(run_sweep(argc - 2, argv + 2));
+    }
+    if( (argc > 1) && (strcmp(argv[1], "--session") == 0) ) {
+        exit(run_session(argc - 2, argv + 2));
+    }
+    if( (argc > 1) && (strcmp(argv[1], "--compile-model") == 0) ) {
+        exit(run_compile_model(argc - 2, argv + 2));
+    }
+    if( (argc > 1) && (strcmp(argv[1], "--bench") == 0) ) {
+        exit(run_bench(argc - 2, argv + 2));
+    }
+    if( (argc > 1) && (strcmp(argv[1], "--footprint") == 0) ) {
+        exit(run_footprint());
+    }
+    if( (argc > 1) && (strcmp(argv[1], "--energy") == 0) ) {
+        exit(run_energy(argc - 2, argv + 2));
+    }
+    if( (argc > 1) && (strcmp(argv[1], "--replay") == 0) ) {
+        exit(run_replay(argc - 2, argv + 2));
+    }
+    if( (argc > 1) && (strcmp(argv[1], "--load") == 0) ) {
+        exit(run_load(argc - 2, argv + 2));
+    }
+    if( (argc > 1) && (strcmp(argv[1], "--diff") == 0) ) {
+        exit(run_diff(argc - 2, argv + 2));
+    }
+    if( (argc > 1) && (strcmp(argv[1], "--batch") == 0) ) {
+        exit(run_batch(argc - 2, argv + 2));
+    }
+    if( (argc > 1) && (strcmp(argv[1], "--merge") == 0) ) {
+        exit(run_merge(argc - 2, argv + 2));
+    }
 
-    fpin = fopen(argv[1], "r");
-    if(fpin == NULL) {
-        printf("Cannot open input file: %s\n", argv[1]);
+    if( argc != 3) {
+        printf("Usage: %s [--magnitude] [--gyro] [--model] [--filter lp:order:fc|bp:order:f1:f2] [--simd auto|scalar|sse2|avx2] [--numa on|off] [--features featfile] inputfile outputfile    (inputfile - streams from stdin)\n", argv[0]);
+        printf("       %s --sweep [-j threads] configfile outputfile inputfile [inputfile ...]\n", argv[0]);
+        printf("       %s --session outputfile inputfile [inputfile ...]\n", argv[0]);
+        printf("       %s --compile-model modelfile headerfile\n", argv[0]);
+        printf("       %s --bench [benchmark]\n", argv[0]);
+        printf("       %s --footprint\n", argv[0]);
+        printf("       %s --energy [-c mac:cmp:div:mem] inputfile [inputfile ...]    (build with -DSTEP_ALGO_OPCOUNT)\n", argv[0]);
+        printf("       %s --replay [-x speedup] inputfile [inputfile ...]\n", argv[0]);
+        printf("       %s --load [-j threads] [-x speedup] [-t seconds] [-n max_devices] [inputfile ...]\n", argv[0]);
+        printf("       %s --diff [-n signals] [-s seed] [-w tracefile | -t tracefile] [inputfile ...]\n", argv[0]);
+        printf("       %s --batch [-j threads] [-q depth] [-r uring|stdio|both] [--shard i/N] [-o summaryfile] manifestfile\n", argv[0]);
+        printf("       %s --merge summaryfile [summaryfile ...]\n", argv[0]);
         exit(1);
     }
 
+    if( strcmp(argv[1], "-") == 0 ) {
+        /* Live stream, unbuffered so that poll() sees every pending sample */
+        fpin = stdin;
+        setvbuf(fpin, NULL, _IONBF, 0);
+        streaming = 1;
+    }
+    else {
+        fpin = fopen(argv[1], "r");
+        if(fpin == NULL) {
+            printf("Cannot open input file: %s\n", argv[1]);
+            exit(1);
+        }
+    }
+
     fpout = fopen(argv[2], "w");
     if(fpout == NULL) {
         printf("Cannot open output file: %s\n", argv[2]);
         exit(1);
     }
 
-    /* Algorithm uses a 2nd order low pass filter to smoothen the input sensor data   */
-    /* and a 2nd order lead-lag filter to estimate time derivate of input sensor data */
-    
-    /* Initialize 2nd order low pass fitler data, 3Hz cut-off */
-    lp_filter_x.b0 = lp_filter_y.b0 = lp_filter_z.b0 = 7.2269463E-03f;
-    lp_filter_x.b1 = lp_filter_y.b1 = lp_filter_z.b1 = 1.4453893E-02f;
-    lp_filter_x.b2 = lp_filter_y.b2 = lp_filter_z.b2 = 7.2269463E-03f;
-    lp_filter_x.a1 = lp_filter_y.a1 = lp_filter_z.a1 = -1.7455322E+0f;
-    lp_filter_x.a2 = lp_filter_y.a2 = lp_filter_z.a2 = 7.7444003E-01f;
-    lp_filter_x.prev_in = lp_filter_y.prev_in = lp_filter_z.prev_in = 0.0f;
-    lp_filter_x.prev_prev_in = lp_filter_y.prev_prev_in = lp_filter_z.prev_prev_in = 0.0f;
-    lp_filter_x.prev_out = lp_filter_y.prev_out = lp_filter_z.prev_out = 0.0f;
-    lp_filter_x.prev_prev_out = lp_filter_y.prev_prev_out = lp_filter_z.prev_prev_out = 0.0f;
-    timeconst_samp = (unsigned int)(SENSOR_SAMP_FREQ*0.075f) + 1;
-    if (timeconst_samp > MAX_TC_SAMPLES)
-        timeconst_samp = MAX_TC_SAMPLES;
-    lp_filter_x.TC_samples = lp_filter_y.TC_samples = lp_filter_z.TC_samples = timeconst_samp;
-
-    /* Initialize 2nd order lead lag fitler data, 4Hz cut-off */
-    ll_filter_x.b0 = ll_filter_y.b0 = ll_filter_z.b0 = 2.5369363f;
-    ll_filter_x.b1 = ll_filter_y.b1 = ll_filter_z.b1 = 0.0f;
-    ll_filter_x.b2 = ll_filter_y.b2 = ll_filter_z.b2 = -2.5369363f;
-    ll_filter_x.a1 = ll_filter_y.a1 = ll_filter_z.a1 = -1.6641912f;
-    ll_filter_x.a2 = ll_filter_y.a2 = ll_filter_z.a2 = 0.71297842f;
-    ll_filter_x.prev_in = ll_filter_y.prev_in = ll_filter_z.prev_in = 0.0f;
-    ll_filter_x.prev_prev_in = ll_filter_y.prev_prev_in = ll_filter_z.prev_prev_in = 0.0f;
-    ll_filter_x.prev_out = ll_filter_y.prev_out = ll_filter_z.prev_out = 0.0f;
-    ll_filter_x.prev_prev_out = ll_filter_y.prev_prev_out = ll_filter_z.prev_prev_out = 0.0f;
-    timeconst_samp = (unsigned int)(SENSOR_SAMP_FREQ*0.06f) + 1;
-    if (timeconst_samp > MAX_TC_SAMPLES)
-        timeconst_samp = MAX_TC_SAMPLES;
-    ll_filter_x.TC_samples = ll_filter_y.TC_samples = ll_filter_z.TC_samples = timeconst_samp;
-
-    /* Initialize algo output data struct */
-    step_algo_output.prev_max = 0.0;
-    step_algo_output.prev_max_ts = 0.0;
-    step_algo_output.prev_min = 0.0;
-    step_algo_output.prev_min_ts = 0.0;
-    step_algo_output.step_count = 0;
-    step_algo_output.step_type = 0;
+    /* Initialize filters, algo state and algo output data struct */
+    init_algo_out(&step_algo.out);
+    step_algo_reset(&step_algo);
 
     /* Skip the first two lines of input file */
-    while( (skip_lines > 0) && (NULL != fgets(line_buff, MAX_CHAR_PER_LINE, fpin)) ) {
-        skip_lines--;
-    }
-    if( skip_lines > 0 ) {
-        printf("Cannot read first two lines of input file: %s\n", argv[2]);
+    if( skip_header(fpin) != 0 ) {
+        printf("Cannot read first two lines of input file: %s\n", argv[1]);
         exit(1);
     }
 
-    fprintf(fpout, "RECORD, TYPE, DATE, TIME, arx, ary, arz, grx, gry, grz, timestamp(sec), step_count, step_type, step_type_num\n");
+    write_out_header(fpout);
     /* Process input sensor data from input file and save result in output file */
-    while (NULL != fgets(line_buff, MAX_CHAR_PER_LINE, fpin))
+    while (1)
     {
-        sscanf(line_buff, "%d, %d, %[^,], %[^,], %f, %f, %f, %f, %f, %f\n",
-            &rec_id, &sen_id, date, time, &arx, &ary, &arz, &grx, &gry, &grz);
+        if (streaming == 1) {
+            struct pollfd  pfd = { fileno(fpin), POLLIN, 0 };
+
+            if (poll(&pfd, 1, (int)(STREAM_FLUSH_TIMEOUT_SEC*1000)) == 0) {
+                /* Stream stalled for the timeout on the wall clock, don't */
+                /* hold back the samples received so far                   */
+                step_algo_finalize(&step_algo);
+                fflush(fpout);
+                continue;
+            }
+        }
+        if (read_sens_data(fpin, &sens_data) != 0)
+            break;
+
         timestamp += SENSOR_SAMP_INTVL;
 
-        run_step_algo = step_algo_preproc( timestamp, arx, ary, arz, grx, gry, grz );
+        run_step_algo = step_algo_preproc( &step_algo, timestamp, sens_data.arx, sens_data.ary, sens_data.arz,
+                                           sens_data.grx, sens_data.gry, sens_data.grz );
         if (run_step_algo == 1) {
             /* Collected enough sensor data to run step detect and count */
-            step_algo_run(&step_algo_output);
+            step_algo_run(&step_algo);
         }
 
-        if( step_algo_output.step_type == STATIC )
-            step_type = "STATIONARY";
-        else if( step_algo_output.step_type == WALK )
-            step_type = "WALKING";
-        else if( step_algo_output.step_type == RUN )
-            step_type = "RUNNING";
-        else if( step_algo_output.step_type == HOP )
-            step_type = "HOPPING";
-         
-        fprintf(fpout, "%d, %d, %s, %s, %f, %f, %f, %f, %f, %f, %f, %d, %s, %d\n", 
-            rec_id, sen_id, date, time, arx, ary, arz, grx, gry, grz, 
-            timestamp, step_algo_output.step_count, step_type, step_algo_output.step_type);
+        write_out_data(fpout, &sens_data, timestamp, &step_algo.out);
+        if (streaming == 1)
+            fflush(fpout);
     }
 
-    printf("Total motion duration is %f sec, which contains approximatly:\n %d Total number of steps including\n |---> %d steps of WALKING, \n |---> %d steps of RUNNING, and \n |---> %d steps of HOPPING.\n", timestamp, num_steps_walk+num_steps_run+num_steps_hop, num_steps_walk, num_steps_run, num_steps_hop);
+    /* Process the trailing samples that did not fill a complete buffer */
+    step_algo_finalize(&step_algo);
+
+    print_summary(timestamp, &step_algo.out);
     printf("Done.\n");
+    if (FeatFile != NULL)
+        fclose(FeatFile);
     exit(0);
 
 }
 
 
-/* Algo date preprocessing function called by Main to do some preprocessing of sensor input data 
-*  and store the preprocessed data in a buffer.
-*  Only call algorithm to run when the sensor input buffer is full, this saves power
-*  Input: Timestamp in sec, AccX, AccY, AccZ, GyroX, GyroY, GyroZ data
-*  Output: 1 if sensor input buffer is full, 0 otherwise
+/* Session mode, processes an ordered list of consecutive recording files as
+*  one continuous stream. Filter and algo state are carried across file
+*  boundaries and only reset when the DATE or TIME shows a real gap.
+*  Input: Session arguments: outputfile inputfile [inputfile ...]
+*  Output: Exit code
 */
-static unsigned int step_algo_preproc(float timestamp, float arx, float ary, float arz, float grx, float gry, float grz)
+static int run_session(int argc, char *argv[])
 {
-    static unsigned int count = 0;
-    unsigned int  ret_val = 0;
-    float         ary_flt = 0.0f;
-
-    /* Only use y-axis accelerometer data for algo      */
-    /* Filter input sensor data before saving in buffer */
-    ary_flt = apply_filter(&lp_filter_y, ary);
-    AccBuff[CHY][count] = ary_flt;
-    AccBuff[CHZ + 1][count] = timestamp;
-    count = count + 1;
-    if (count == SAMP_BUFF_LEN) {
-        /* buffer is full, signal algo to run */
-        ret_val = 1;
-        count = 0;
+    FILE          *fpout;
+    unsigned int  num_segments, num_filled;
+    float         timestamp;
+
+    if (argc < 2) {
+        printf("Usage: --session outputfile inputfile [inputfile ...]\n");
+        return 1;
     }
 
-    return ret_val;
+    fpout = fopen(argv[0], "w");
+    if (fpout == NULL) {
+        printf("Cannot open output file: %s\n", argv[0]);
+        return 1;
+    }
+
+    if (session_process(fpout, argv + 1, argc - 1, &step_algo, &timestamp, &num_segments, &num_filled) != 0)
+        return 1;
+    fclose(fpout);
+
+    print_summary(timestamp, &step_algo.out);
+    printf("Processed %d files as %u continuous segments, %u missing records filled.\n", argc - 1,
+        num_segments, num_filled);
+    printf("Done.\n");
+    if (FeatFile != NULL)
+        fclose(FeatFile);
+
+    return 0;
 
 }
 
 
-/* The main algorithm, processes the sensor input data in sensor input buffer 
-*  stored by preproc function to detect step type and estimate step count.
-*  The algorithm estimates frequency and amplitude of the accel y-axis data
-*  by finding max and min values.
-*  Max and min values have derivate of 0, thus a lead-lag filter is used to 
-*  take derivative of the input data. The zero-crossings of derivative data
-*  provides max and min values of input data.
-*  The  zero crossing is computed by finding points where the data changes sign.
-*  Input: Pointer to the algo output data
-*  Output: None
+/* Process recording files as one stream, the core of the session mode.
+*  Up to SESSION_MAX_FILL missing RECORD ids (dropped samples) are filled by
+*  repeating the last sample, the stream starts over at a gap of sens_data_gap.
+*  Input: Output file (NULL for none), input files, number of input files,
+*         algo instance, session duration in sec, number of continuous
+*         segments and of filled records (outputs)
+*  Output: 0 on success, -1 if an input file cannot be read
 */
-static void step_algo_run(algo_out_t *step_algo_output)
+static int session_process(FILE *fpout, char *files[], int num_files, step_algo_t *algo, float *timestamp,
+                           unsigned int *num_segments, unsigned int *num_filled)
 {
-#define VERY_HIGH_VAL          ( 100000 )
-#define NO_DETECT_DUR_SEC      ( 0.2f )    /* Duration to avoid very close peaks not related to step */
-#define CLOSE_TO_ZERO          ( 1.5 )     /* Threshold to detect if peak is reasonable height       */
-#define MAX_TIME_PERIOD_SEC    ( 1.5f )    /* Maximum time duration of one step                      */
-#define SMALL_AMP              ( 5.0 )     /* Lower threshold for change in accel during a step      */
-#define LARGE_AMP              ( 15.0 )    /* Higher threshold for change in accel during a step     */
-#define SLOW_FREQ              ( 0.5 )     /* Lower threshold for step rate during a step            */
-#define FAST_FREQ              ( 2.2 )     /* Lower threshold for step rate during a step            */
+    FILE          *fpin;
+    sens_data_t   sens_data, prev_data;
+    unsigned int  have_prev = 0, missing, i;
+    float         seg_timestamp = 0.0f; /* sec since start of continuous segment */
+    int           f;
 
-    /* Local Variables */
-    unsigned int         i;
-    float                prev_max_val, prev_max_ts, prev_min_val, prev_min_ts;
-    float                new_max_val, new_max_ts, new_min_val, new_min_ts;
-    float                avg_max_val = 0.0f, avg_min_val = 0.0f, avg_time_period = 0.0f;
-    float                freq_est = 0.0f, amp_est = 0.0f;
-    unsigned int         delta = 1;     /* distance between two samples to be compared   */
-    unsigned int         count_max_det = 0, count_min_det = 0;
-    unsigned int         TC_samples = 0;
-    
-    /* Local Static Variables to maintain state of algo and static array allocation  */
-    static float         prev_amp_est = 0.0f, prev_freq_est = 0.0f;
-    static unsigned int  amp_est_hold = 0, freq_est_hold = 0;
-      static float         prevAccDer = 0.0f;
-    static float         AccFilt[SAMP_BUFF_LEN + MAX_TC_SAMPLES] = { 0 };
-    static float         TimeStamps[SAMP_BUFF_LEN + MAX_TC_SAMPLES] = { 0 };
-    static float         AccDer[SAMP_BUFF_LEN] = { 0 }; /* Derivative of Accel Data */
+    init_algo_out(&algo->out);
+    step_algo_reset(algo);
+    *timestamp = 0.0f;                  /* sec since start of session */
+    *num_segments = 1;
+    *num_filled = 0;
 
-    /* Initialize variables */
-    new_max_val = -VERY_HIGH_VAL;
-    new_min_val = VERY_HIGH_VAL;
-    new_max_ts = 0.0f;
-    new_min_ts = 0.0f;
-    
-    /* Prev max and min values and their timestamps are   */
-    /* needed to estimate one step in cases where data for*/
-    /* one step span accross multiple calls to this algo  */
-    prev_max_val = step_algo_output->prev_max;
-    prev_max_ts = step_algo_output->prev_max_ts;
-    prev_min_val = step_algo_output->prev_min;
-    prev_min_ts = step_algo_output->prev_min_ts;
-    
-    /* Delay between derivative and filtered data due to  */
-    /* derivate (lead0lag) fiter delay                    */
-    TC_samples = ll_filter_y.TC_samples;
+    if (fpout != NULL)
+        write_out_header(fpout);
+    for (f = 0; f < num_files; f++) {
+        fpin = fopen(files[f], "r");
+        if (fpin == NULL) {
+            printf("Cannot open input file: %s\n", files[f]);
+            return -1;
+        }
+        if (skip_header(fpin) != 0) {
+            printf("Cannot read first two lines of input file: %s\n", files[f]);
+            fclose(fpin);
+            return -1;
+        }
 
-    for (i = 0; i < SAMP_BUFF_LEN; i++) {
-        /* Compute the derivative of filtered Y-axis Acc Data  */
-        AccDer[i] = apply_filter(&ll_filter_y, AccBuff[CHY][i]);
-        /* AccFilt and TimeStamps are extended buffers to save */
-        /* prev TC_samples along with new Y-axis Acc Data      */
-        AccFilt[TC_samples + i] = AccBuff[CHY][i];
-        TimeStamps[TC_samples + i] = AccBuff[CHZ+1][i];
-    }
-    
-    /* Find the new max/min values of Filtered Y-axis Acc Data and timestamp             */
-    /* This is done by detecting rising/falling zero crossings in derivative of Acc Data */
-    for (i = 0; i < SAMP_BUFF_LEN; i = i + delta) {
-        if (i >= delta)
-            prevAccDer = AccDer[i-delta];
-        
-        if (prev_max_ts <= prev_min_ts) {
-            /* need to find the next max val(falling ZC) */
-            if ((AccDer[i] < -EPSILON) && (prevAccDer >= 0.0f)) {
-                /* Avoid searching very close to already found max value */
-                if (TimeStamps[i] - prev_max_ts > NO_DETECT_DUR_SEC) {
-                    new_max_val = AccFilt[i];
-                    if (fabs(new_max_val) > CLOSE_TO_ZERO) {
-                        new_max_ts = TimeStamps[i];
-                        /* Clamp diff betweeen new_max_ts and prev_max_ts to avoid */
-                        /* distortion in estimation of step frequency              */
-                        if (new_max_ts > prev_max_ts + MAX_TIME_PERIOD_SEC)
-                            prev_max_ts = new_max_ts - MAX_TIME_PERIOD_SEC;
-                        /* Avoid max vlaue which is very close to prev min value   */
-                        if (new_max_val - prev_min_val > CLOSE_TO_ZERO) {
-                            avg_time_period = avg_time_period + (new_max_ts - prev_max_ts);
-                            avg_max_val = avg_max_val + new_max_val;
-                            count_max_det = count_max_det + 1;
-                            prev_max_ts = new_max_ts;
-                            prev_max_val = new_max_val;
-                        }
-                    }
-                }
+        while (read_sens_data(fpin, &sens_data) == 0) {
+            missing = 0;
+            if ((have_prev == 1) && (sens_data_gap(&prev_data, &sens_data) == 1)) {
+                /* Discontinuity, finish the previous segment and start over */
+                step_algo_finalize(algo);
+                step_algo_reset(algo);
+                seg_timestamp = 0.0f;
+                (*num_segments)++;
             }
-        }
-        else {
-            /* need to find the next min val(rising ZC) */
-            if ((AccDer[i] > EPSILON) && (prevAccDer <= 0.0f)) {
-                /* Avoid searching very close to already found min value */
-                if (TimeStamps[i] - prev_min_ts > NO_DETECT_DUR_SEC) {
-                    new_min_val = AccFilt[i];
-                    new_min_ts = TimeStamps[i];
-                    /* Clamp diff betweeen new_max_ts and prev_max_ts to avoid */
-                    /* distortion in estimation of step frequency              */
-                    if (new_min_ts > prev_min_ts + MAX_TIME_PERIOD_SEC)
-                        prev_min_ts = new_min_ts - MAX_TIME_PERIOD_SEC;
-                    /* Avoid min vlaue which is very close to prev max value   */
-                    if (prev_max_val - new_min_val > CLOSE_TO_ZERO) {
-                        avg_time_period = avg_time_period + (new_min_ts - prev_min_ts);
-                        avg_min_val = avg_min_val + new_min_val;
-                        amp_est += prev_max_val - new_min_val;
-                        /* A pair of max and min is one step and is equal to   */
-                        /* the value of count_min_det                          */
-                        count_min_det = count_min_det + 1;
-                        prev_min_ts = new_min_ts;
-                        prev_min_val = new_min_val;
-                    }
-                }
+            else if ((have_prev == 1) && (sens_data.rec_id > prev_data.rec_id + 1))
+                missing = sens_data.rec_id - prev_data.rec_id - 1;
+
+            /* Keep the sample clock of the dropped samples */
+            for (i = 0; i < missing; i++) {
+                *timestamp += SENSOR_SAMP_INTVL;
+                seg_timestamp += SENSOR_SAMP_INTVL;
+                if (step_algo_preproc(algo, seg_timestamp, prev_data.arx, prev_data.ary, prev_data.arz,
+                                      prev_data.grx, prev_data.gry, prev_data.grz) == 1)
+                    step_algo_run(algo);
             }
+            *num_filled += missing;
+
+            *timestamp += SENSOR_SAMP_INTVL;
+            seg_timestamp += SENSOR_SAMP_INTVL;
+            if (step_algo_preproc(algo, seg_timestamp, sens_data.arx, sens_data.ary, sens_data.arz,
+                                  sens_data.grx, sens_data.gry, sens_data.grz) == 1)
+                step_algo_run(algo);
+
+            if (fpout != NULL)
+                write_out_data(fpout, &sens_data, *timestamp, &algo->out);
+            prev_data = sens_data;
+            have_prev = 1;
         }
+        fclose(fpin);
     }
+    step_algo_finalize(algo);
 
-    if (count_min_det > 0) {
-        amp_est = amp_est / count_min_det;
-        amp_est_hold = 0;
-    }
-    else {
-        amp_est = prev_amp_est;
-        amp_est_hold++;
-    }
-    if( amp_est_hold > BUFF_FACTOR ) {
-        amp_est_hold = 0;
-        amp_est = 0.0f;
-    }
+    return 0;
 
-    if (count_max_det + count_min_det > 0) {
-        avg_time_period = avg_time_period / (count_max_det + count_min_det);
-    }
-    if (avg_time_period > EPSILON) {
-        freq_est = 1 / avg_time_period;
-        freq_est_hold = 0;
-    }
-    else {
-        freq_est = prev_freq_est;
-        freq_est_hold++;
-    }
-    if( freq_est_hold > BUFF_FACTOR ) {
-        freq_est_hold = 0;
-        freq_est = 0.0f;
-    }
+}
 
-    /* Save the last TC_samples for next run */
-    for (i = 0; i < TC_samples; i++) {
-        AccFilt[i] = AccBuff[CHY][SAMP_BUFF_LEN - TC_samples + i];
-        TimeStamps[i] = AccBuff[CHZ+1][SAMP_BUFF_LEN - TC_samples + i];
-    }
-    /* Save selected algo data for the next run */
-    prevAccDer = AccDer[SAMP_BUFF_LEN-1];
-    prev_amp_est = amp_est;
-    prev_freq_est = freq_est;
 
-    /* Update the algo output */
-    step_algo_output->prev_max = prev_max_val;
-    step_algo_output->prev_max_ts = prev_max_ts;
-    step_algo_output->prev_min = prev_min_val;
-    step_algo_output->prev_min_ts = prev_min_ts;
-    step_algo_output->step_count += count_min_det;
-    if (amp_est <= SMALL_AMP) {
-        if (freq_est <= SLOW_FREQ)
-            /* STATIONARY */
-            step_algo_output->step_type = STATIC;
-        else {
-            /* WALKING */
-            step_algo_output->step_type = WALK;
-            num_steps_walk += count_min_det;
-        }
-    }
-    else if (amp_est >= LARGE_AMP) {
-        if (freq_est >= FAST_FREQ) {
-            /* RUNNING */
-            step_algo_output->step_type = RUN;
-            num_steps_run += count_min_det;
-        }
-        else {
-            /* HOPPINNG */
-            step_algo_output->step_type = HOP;
-            num_steps_hop += count_min_det;
-        }
+/* Check for a discontinuity between two consecutive rows of sensor data,
+*  i.e. a different DATE, a TIME gap of more than SESSION_MAX_GAP_SEC (TIME
+*  has a resolution of one second) or more than SESSION_MAX_FILL missing
+*  RECORD ids. Smaller RECORD gaps are dropped samples within the stream,
+*  see session_process.
+*  Input: Previous and current sensor data
+*  Output: 1 if there is a gap, 0 otherwise
+*/
+static int sens_data_gap(const sens_data_t *prev_data, const sens_data_t *sens_data)
+{
+    unsigned int  prev_h, prev_m, prev_s, h, m, s;
+    int           delta;
+
+    if (strcmp(sens_data->date, prev_data->date) != 0)
+        return 1;
+    if ((sens_data->rec_id > prev_data->rec_id + 1) && (sens_data->rec_id - prev_data->rec_id - 1 > SESSION_MAX_FILL))
+        return 1;
+    if ((sscanf(prev_data->time, "%u:%u:%u", &prev_h, &prev_m, &prev_s) == 3) &&
+        (sscanf(sens_data->time, "%u:%u:%u", &h, &m, &s) == 3)) {
+        delta = (int)(h * 3600 + m * 60 + s) - (int)(prev_h * 3600 + prev_m * 60 + prev_s);
+        if ((delta < 0) || (delta > SESSION_MAX_GAP_SEC))
+            return 1;
     }
-    else {
-        if (freq_est >= FAST_FREQ) {
-            /* RUNNING */
-            step_algo_output->step_type = RUN;
-            num_steps_run += count_min_det;
-        }
-        else {
-            /* WALKING */
-            step_algo_output->step_type = WALK;
-            num_steps_walk += count_min_det;
-        }
+
+    return 0;
+
+}
+
+
+/* Write the column header of the output file
+*  Input: Output file
+*  Output: None
+*/
+static void write_out_header(FILE *fpout)
+{
+    fprintf(fpout, "RECORD, TYPE, DATE, TIME, arx, ary, arz, grx, gry, grz, timestamp(sec), step_count, step_type, step_type_num\n");
+
+}
+
+
+/* Write one row of sensor data and the current algo output to the output file
+*  Input: Output file, sensor data, timestamp in sec, pointer to the algo output data
+*  Output: None
+*/
+static void write_out_data(FILE *fpout, const sens_data_t *sens_data, float timestamp, const algo_out_t *step_algo_output)
+{
+    char          *step_type = "STATIONARY";
+
+    if( step_algo_output->step_type == STATIC )
+        step_type = "STATIONARY";
+    else if( step_algo_output->step_type == WALK )
+        step_type = "WALKING";
+    else if( step_algo_output->step_type == RUN )
+        step_type = "RUNNING";
+    else if( step_algo_output->step_type == HOP )
+        step_type = "HOPPING";
+
+    fprintf(fpout, "%d, %d, %s, %s, %f, %f, %f, %f, %f, %f, %f, %d, %s, %d\n",
+        sens_data->rec_id, sens_data->sen_id, sens_data->date, sens_data->time,
+        sens_data->arx, sens_data->ary, sens_data->arz, sens_data->grx, sens_data->gry, sens_data->grz,
+        timestamp, step_algo_output->step_count, step_type, step_algo_output->step_type);
+
+}
+
+
+/* Print the total motion duration and the number of steps per motion type
+*  Input: Motion duration in sec, pointer to the algo output data
+*  Output: None
+*/
+static void print_summary(float duration, const algo_out_t *step_algo_output)
+{
+    printf("Total motion duration is %f sec, which contains approximatly:\n %d Total number of steps including\n |---> %d steps of WALKING, \n |---> %d steps of RUNNING, and \n |---> %d steps of HOPPING.\n", duration,
+        step_algo_output->type_steps[WALK] + step_algo_output->type_steps[RUN] + step_algo_output->type_steps[HOP],
+        step_algo_output->type_steps[WALK], step_algo_output->type_steps[RUN], step_algo_output->type_steps[HOP]);
+
+}
+
+
+/* Skip the first two (header) lines of the sensor input file
+*  Input: Input file
+*  Output: 0 on success, -1 if the file is too short
+*/
+static int skip_header(FILE *fpin)
+{
+    char          line_buff[MAX_CHAR_PER_LINE] = { 0 };
+    unsigned int  skip_lines = 2;
+
+    while( (skip_lines > 0) && (NULL != fgets(line_buff, MAX_CHAR_PER_LINE, fpin)) ) {
+        skip_lines--;
     }
 
+    return (skip_lines > 0) ? -1 : 0;
+
 }
- 
-/* Apply second order filter on input data 
-*  Update filter state for the next run
-*  Input: Pointer to filter state var, Input data to filter
-*  Output: Filtered data
+
+
+/* Read and parse one row of sensor data from the sensor input file
+*  Input: Input file, pointer to the sensor data to fill
+*  Output: 0 on success, -1 at end of file
 */
-static float apply_filter(filter_t *filt_data, float in_data)
+static int read_sens_data(FILE *fpin, sens_data_t *sens_data)
 {
-    float out_data;
+    char          line_buff[MAX_CHAR_PER_LINE] = { 0 };
 
-    /* compute new output */
-    out_data = (filt_data->b0 * in_data) + (filt_data->b1 * filt_data->prev_in) + (filt_data->b2 * filt_data->prev_prev_in) \
-        - (filt_data->a1 * filt_data->prev_out) - (filt_data->a2 * filt_data->prev_prev_out);
-    
-    /* update state of filter */
-    filt_data->prev_prev_in = filt_data->prev_in;
-    filt_data->prev_in = in_data;
-    filt_data->prev_prev_out = filt_data->prev_out;
-    filt_data->prev_out = out_data;
+    if (NULL == fgets(line_buff, MAX_CHAR_PER_LINE, fpin))
+        return -1;
+    parse_sens_data(line_buff, sens_data);
 
-    return out_data;
+    return 0;
+
+}
+
+
+/* Parse one row of sensor data
+*  Input: Line of the sensor input file, pointer to the sensor data to fill
+*  Output: None
+*/
+static void parse_sens_data(const char *line_buff, sens_data_t *sens_data)
+{
+    sscanf(line_buff, "%u, %u, %[^,], %[^,], %f, %f, %f, %f, %f, %f\n",
+        &sens_data->rec_id, &sens_data->sen_id, sens_data->date, sens_data->time,
+        &sens_data->arx, &sens_data->ary, &sens_data->arz, &sens_data->grx, &sens_data->gry, &sens_data->grz);
 
 }
 
+
+/* Initialize 2nd order low pass fitler data, 3Hz cut-off
+*  Input: Pointer to filter state var
+*  Output: None
+*/
+static void init_lp_filter(filter_t *filt_data)
+{
+    unsigned int  timeconst_samp = 0;
+
+    filt_data->b0 = 7.2269463E-03f;
+    filt_data->b1 = 1.4453893E-02f;
+    filt_data->b2 = 7.2269463E-03f;
+    filt_data->a1 = -1.7455322E+0f;
+    filt_data->a2 = 7.7444003E-01f;
+    filt_data->prev_in = 0.0f;
+    filt_data->prev_prev_in = 0.0f;
+    filt_data->prev_out = 0.0f;
+    filt_data->prev_prev_out = 0.0f;
+    timeconst_samp = (unsigned int)(SENSOR_SAMP_FREQ*0.075f) + 1;
+    if (timeconst_samp > MAX_TC_SAMPLES)
+        timeconst_samp = MAX_TC_SAMPLES;
+    filt_data->TC_samples = timeconst_samp;
+
+}
+
+
+/* Initialize 2nd order lead lag fitler data, 4Hz cut-off
+*  Input: Pointer to filter state var
+*  Output: None
+*/
+static void init_ll_filter(filter_t *filt_data)
+{
+    unsigned int  timeconst_samp = 0;
+
+    filt_data->b0 = 2.5369363f;
+    filt_data->b1 = 0.0f;
+    filt_data->b2 = -2.5369363f;
+    filt_data->a1 = -1.6641912f;
+    filt_data->a2 = 0.71297842f;
+    filt_data->prev_in = 0.0f;
+    filt_data->prev_prev_in = 0.0f;
+    filt_data->prev_out = 0.0f;
+    filt_data->prev_prev_out = 0.0f;
+    timeconst_samp = (unsigned int)(SENSOR_SAMP_FREQ*0.06f) + 1;
+    if (timeconst_samp > MAX_TC_SAMPLES)
+        timeconst_samp = MAX_TC_SAMPLES;
+    filt_data->TC_samples = timeconst_samp;
+
+}
+
+
+/* Initialize algo output data struct
+*  Input: Pointer to the algo output data
+*  Output: None
+*/
+static void init_algo_out(algo_out_t *step_algo_output)
+{
+    memset(step_algo_output, 0, sizeof(*step_algo_output));
+    step_algo_output->step_type = STATIC;
+
+}
+
+
+/* Reset the filters, sensor input buffer and algo state of an instance to
+*  start a new continuous stream, e.g. after a gap in the sensor data.
+*  The step totals in the algo output data are kept.
+*  Input: Pointer to the algo instance
+*  Output: None
+*/
+static void step_algo_reset(step_algo_t *algo)
+{
+    algo_out_t    *step_algo_output = &algo->out;
+
+    /* Algorithm uses a 2nd order low pass filter to smoothen the input sensor data   */
+    /* and a 2nd order lead-lag filter to estimate time derivate of input sensor data */
+    init_lp_filter(&algo->lp_filter_y);
+    init_ll_filter(&algo->ll_filter_y);
+    algo->sos_filter_y = SosFilterY;
+    reset_sos_filter(&algo->sos_filter_y);
+
+    algo->AccBuffCount = 0;
+    algo->prevAccDer = 0.0f;
+    memset(algo->AccFilt, 0, sizeof(algo->AccFilt));
+    algo->tick = 0;
+#if !defined(STEP_ALGO_MIN_RAM)
+    init_lp_filter(&algo->lp_filter_g);
+    /* shared by all instances, computed by the first reset of any thread */
+    pthread_once(&SpecTablesOnce, init_spec_tables);
+    algo->GravBaseline = GRAV_BASELINE_UNINIT;
+    memset(algo->TimeStamps, 0, sizeof(algo->TimeStamps));
+    memset(algo->GyroFilt, 0, sizeof(algo->GyroFilt));
+    memset(algo->AccDer, 0, sizeof(algo->AccDer));
+#endif
+
+    step_algo_output->step_type = STATIC;
+    step_algo_output->prev_max = 0.0f;
+    step_algo_output->prev_min = 0.0f;
+    step_algo_output->prev_max_ts = 0.0f;
+    step_algo_output->prev_min_ts = 0.0f;
+    step_algo_output->prev_amp_est = 0.0f;
+    step_algo_output->prev_freq_est = 0.0f;
+    step_algo_output->amp_est_hold = 0;
+    step_algo_output->freq_est_hold = 0;
+
+}
+
+
+/* Algo date preprocessing function called by Main to do some preprocessing of sensor input data
+*  and store the preprocessed data in a buffer.
+*  Only call algorithm to run when the sensor input buffer is full, this saves power
+*  Input: Pointer to the algo instance, timestamp in sec (not used by the minimal
+*         RAM profile, which counts samples), AccX, AccY, AccZ, GyroX, GyroY, GyroZ data
+*  Output: 1 if sensor input buffer is full, 0 otherwise
+*/
+static unsigned int step_algo_preproc(step_algo_t *algo, float timestamp, float arx, float ary, float arz, float grx, float gry, float grz)
+{
+    unsigned int  ret_val = 0;
+    unsigned int  n = algo->AccBuffCount;
+
+    OPS_COUNT(OPS_PREPROC, OPS_CMP, 1);     /* buffer full */
+    OPS_COUNT(OPS_PREPROC, OPS_MEM, 3);     /* count load and store, AccBuffY store */
+#if defined(STEP_ALGO_MIN_RAM)
+    /* Only use y-axis accelerometer data for algo, the cascaded filter */
+    /* is applied to the whole buffer at once before running the algo   */
+    algo->AccBuffY[n] = (algo->sos_filter_y.num_sect > 0) ? ary : apply_filter(&algo->lp_filter_y, ary);
+    OPS_COUNT(OPS_PREPROC, OPS_CMP, 1);
+    OPS_COUNT(OPS_PREPROC, OPS_MAC, 1);
+    OPS_COUNT(OPS_PREPROC, OPS_MEM, 2);
+    (void)timestamp;
+    (void)arx;
+    (void)arz;
+    (void)grx;
+    (void)gry;
+    (void)grz;
+#else
+    OPS_COUNT(OPS_PREPROC, OPS_CMP, 4);     /* options */
+    OPS_COUNT(OPS_PREPROC, OPS_MEM, 1);     /* AccBuffTs store */
+    if ((InputMode == INPUT_ACC_MAG) || (algo->sos_filter_y.num_sect > 0)) {
+        /* Save raw data, the magnitude is computed and filtered  */
+        /* for the whole buffer at once before running the algo   */
+        algo->AccBuffX[n] = arx;
+        algo->AccBuffY[n] = ary;
+        algo->AccBuffZ[n] = arz;
+        OPS_COUNT(OPS_PREPROC, OPS_MEM, 2);
+    }
+    else {
+        /* Only use y-axis accelerometer data for algo      */
+        /* Filter input sensor data before saving in buffer */
+        algo->AccBuffY[n] = apply_filter(&algo->lp_filter_y, ary);
+    }
+    if (GyroValidate == 1) {
+        /* Filter gyro energy in the same pass, used to validate steps */
+        algo->GyroBuff[n] = apply_filter(&algo->lp_filter_g, grx * grx + gry * gry + grz * grz);
+        OPS_COUNT(OPS_PREPROC, OPS_MAC, 3);
+        OPS_COUNT(OPS_PREPROC, OPS_MEM, 1);
+    }
+    if ((algo->feat_sink != NULL) || (UseModel == 1)) {
+        OPS_COUNT(OPS_PREPROC, OPS_MEM, NUM_SENS_AXES);
+        algo->RawBuff[CHX][n] = arx;
+        algo->RawBuff[CHY][n] = ary;
+        algo->RawBuff[CHZ][n] = arz;
+        algo->RawBuff[NUM_DIM + CHX][n] = grx;
+        algo->RawBuff[NUM_DIM + CHY][n] = gry;
+        algo->RawBuff[NUM_DIM + CHZ][n] = grz;
+    }
+    algo->AccBuffTs[n] = timestamp;
+#endif
+    algo->tick++;
+    algo->AccBuffCount = n + 1;
+    if (algo->AccBuffCount == SAMP_BUFF_LEN) {
+        /* buffer is full, signal algo to run */
+        ret_val = 1;
+        algo->AccBuffCount = 0;
+    }
+
+    return ret_val;
+
+}
+
+
+/* Batch version of step_algo_preproc for sensor FIFOs, which deliver a burst of
+*  samples per interrupt. The burst is deinterleaved and filtered block by block
+*  (up to the free space of the sensor input buffer) and the algorithm is run
+*  every time the buffer is full; the result is the same as calling
+*  step_algo_preproc (and step_algo_run) for every sample.
+*  Input: Pointer to the algo instance, FIFO layout, FIFO data, number of
+*         samples, timestamp in sec of the first sample (the following are
+*         SENSOR_SAMP_INTVL apart)
+*  Output: Number of times the algorithm was run
+*/
+static unsigned int step_algo_push(step_algo_t *algo, const fifo_desc_t *desc, const void *fifo, unsigned int num_samp, float timestamp)
+{
+    unsigned int  n, len;
+#if !defined(STEP_ALGO_MIN_RAM)
+    unsigned int  i, ax;
+#endif
+    unsigned int  stride = desc->num_axes * ((desc->fmt == FIFO_INT16) ? sizeof(short) : sizeof(float));
+    unsigned int  num_run = 0;
+    const char    *src = (const char *)fifo;
+
+    while (num_samp > 0) {
+        n = algo->AccBuffCount;
+        len = SAMP_BUFF_LEN - n;
+        if (len > num_samp)
+            len = num_samp;
+
+        /* Only deinterleave the axes needed by the enabled options */
+        fifo_deinterleave(desc, src, CHY, len, algo->AccBuffY + n);
+#if !defined(STEP_ALGO_MIN_RAM)
+        if (InputMode == INPUT_ACC_MAG) {
+            fifo_deinterleave(desc, src, CHX, len, algo->AccBuffX + n);
+            fifo_deinterleave(desc, src, CHZ, len, algo->AccBuffZ + n);
+        }
+        if ((GyroValidate == 1) || (algo->feat_sink != NULL) || (UseModel == 1)) {
+            for (ax = 0; ax < NUM_SENS_AXES; ax++)
+                fifo_deinterleave(desc, src, ax, len, algo->RawBuff[ax] + n);
+        }
+        for (i = n; i < n + len; i++) {
+            algo->AccBuffTs[i] = timestamp;
+            timestamp += SENSOR_SAMP_INTVL;
+        }
+#else
+        (void)timestamp;
+#endif
+        num_run += step_algo_preproc_block(algo, n, len);
+        src += len * stride;
+        num_samp -= len;
+    }
+
+    return num_run;
+
+}
+
+
+/* Batch version of step_algo_preproc for callers that hold the sensor data
+*  in one contiguous array per axis. The arrays are copied and filtered block
+*  by block like a FIFO burst in step_algo_push, with the same result as
+*  calling step_algo_preproc (and step_algo_run) for every sample.
+*  Input: Pointer to the algo instance, arrays of AccX, AccY, AccZ, GyroX,
+*         GyroY, GyroZ (NULL if not available, the axis is zero; AccY is
+*         required), timestamps in sec (or NULL, then the samples are
+*         SENSOR_SAMP_INTVL apart from timestamp; ignored by the minimal RAM
+*         profile, which counts samples), number of samples, timestamp in sec
+*         of the first sample
+*  Output: Number of times the algorithm was run
+*/
+static unsigned int step_algo_push_arrays(step_algo_t *algo, const float *const axes[NUM_SENS_AXES], const float *timestamps,
+                                          unsigned int num_samp, float timestamp)
+{
+    unsigned int  n, len, pos;
+#if !defined(STEP_ALGO_MIN_RAM)
+    unsigned int  i, ax;
+#endif
+    unsigned int  num_run = 0;
+
+    for (pos = 0; pos < num_samp; pos += len) {
+        n = algo->AccBuffCount;
+        len = SAMP_BUFF_LEN - n;
+        if (len > num_samp - pos)
+            len = num_samp - pos;
+
+        array_copy(algo->AccBuffY + n, axes[CHY], pos, len);
+#if !defined(STEP_ALGO_MIN_RAM)
+        if (InputMode == INPUT_ACC_MAG) {
+            array_copy(algo->AccBuffX + n, axes[CHX], pos, len);
+            array_copy(algo->AccBuffZ + n, axes[CHZ], pos, len);
+        }
+        if ((GyroValidate == 1) || (algo->feat_sink != NULL) || (UseModel == 1)) {
+            for (ax = 0; ax < NUM_SENS_AXES; ax++)
+                array_copy(algo->RawBuff[ax] + n, axes[ax], pos, len);
+        }
+        if (timestamps != NULL)
+            memcpy(algo->AccBuffTs + n, timestamps + pos, len * sizeof(float));
+        else {
+            for (i = n; i < n + len; i++) {
+                algo->AccBuffTs[i] = timestamp;
+                timestamp += SENSOR_SAMP_INTVL;
+            }
+        }
+#else
+        (void)timestamps;
+        (void)timestamp;
+#endif
+        num_run += step_algo_preproc_block(algo, n, len);
+    }
+
+    return num_run;
+
+}
+
+
+/* Filter the block of samples just placed in the sensor input buffer (AccBuffY
+*  and, as needed by the options, AccBuffX, AccBuffZ, RawBuff and AccBuffTs)
+*  and run the algorithm if the buffer is full
+*  Input: Pointer to the algo instance, first sample of the block in the
+*         buffer, number of samples (up to the end of the buffer)
+*  Output: 1 if the algorithm was run, 0 otherwise
+*/
+static unsigned int step_algo_preproc_block(step_algo_t *algo, unsigned int n, unsigned int len)
+{
+    unsigned int  i;
+
+#if defined(STEP_ALGO_MIN_RAM)
+    if (algo->sos_filter_y.num_sect == 0) {
+        for (i = n; i < n + len; i++)
+            algo->AccBuffY[i] = apply_filter(&algo->lp_filter_y, algo->AccBuffY[i]);
+    }
+#else
+    /* The magnitude and the cascaded filter are computed at once before running the algo */
+    if ((InputMode != INPUT_ACC_MAG) && (algo->sos_filter_y.num_sect == 0)) {
+        for (i = n; i < n + len; i++)
+            algo->AccBuffY[i] = apply_filter(&algo->lp_filter_y, algo->AccBuffY[i]);
+    }
+    if (GyroValidate == 1) {
+        for (i = n; i < n + len; i++)
+            algo->GyroBuff[i] = apply_filter(&algo->lp_filter_g,
+                algo->RawBuff[NUM_DIM + CHX][i] * algo->RawBuff[NUM_DIM + CHX][i] +
+                algo->RawBuff[NUM_DIM + CHY][i] * algo->RawBuff[NUM_DIM + CHY][i] +
+                algo->RawBuff[NUM_DIM + CHZ][i] * algo->RawBuff[NUM_DIM + CHZ][i]);
+    }
+#endif
+    algo->tick += len;
+    algo->AccBuffCount = n + len;
+    if (algo->AccBuffCount == SAMP_BUFF_LEN) {
+        step_algo_run(algo);
+        algo->AccBuffCount = 0;
+        return 1;
+    }
+
+    return 0;
+
+}
+
+
+/* Copy a block of one axis array, zero if the axis is not available
+*  Input: Output array, axis array (or NULL), first sample, number of samples
+*  Output: None
+*/
+static void array_copy(float *out, const float *in, unsigned int pos, unsigned int len)
+{
+    if (in == NULL)
+        memset(out, 0, len * sizeof(float));
+    else
+        memcpy(out, in + pos, len * sizeof(float));
+
+}
+
+
+/* Extract one axis of a block of interleaved FIFO samples, scaled to m/s^2 or
+*  rad/s. Gyro axes of a FIFO without gyro data are zero.
+*  Input: FIFO layout, FIFO data at the first sample, axis (CHX..CHZ for Acc,
+*         NUM_DIM + CHX..CHZ for Gyro), number of samples, output array
+*  Output: None
+*/
+static void fifo_deinterleave(const fifo_desc_t *desc, const void *fifo, unsigned int axis, unsigned int len, float *out)
+{
+    unsigned int  i;
+    float         scale = (axis < NUM_DIM) ? desc->acc_scale : desc->gyro_scale;
+
+    if (axis >= desc->num_axes)
+        memset(out, 0, len * sizeof(float));
+    else if (desc->fmt == FIFO_INT16) {
+        const short *in = (const short *)fifo + axis;
+
+        for (i = 0; i < len; i++)
+            out[i] = in[i * desc->num_axes] * scale;
+    }
+    else {
+        const float *in = (const float *)fifo + axis;
+
+        for (i = 0; i < len; i++)
+            out[i] = in[i * desc->num_axes];
+    }
+
+}
+
+
+/* Initialize an empty sample ring
+*  Input: Pointer to the sample ring
+*  Output: None
+*/
+static void sample_ring_init(sample_ring_t *ring)
+{
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->overruns = 0;
+
+}
+
+
+/* Producer side of the sample ring, called from the sensor interrupt. Only
+*  copies the sample, never blocks and never calls into the algorithm.
+*  Input: Pointer to the sample ring, AccX, AccY, AccZ, GyroX, GyroY, GyroZ data
+*  Output: 0 on success, -1 if the ring is full (the sample is dropped)
+*/
+static int sample_ring_put(sample_ring_t *ring, float arx, float ary, float arz, float grx, float gry, float grz)
+{
+    unsigned int  head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int  tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    float         *s;
+
+    if (head - tail == SAMPLE_RING_LEN) {
+        ring->overruns++;
+        return -1;
+    }
+    s = ring->data[head % SAMPLE_RING_LEN];
+    s[CHX] = arx;
+    s[CHY] = ary;
+    s[CHZ] = arz;
+    s[NUM_DIM + CHX] = grx;
+    s[NUM_DIM + CHY] = gry;
+    s[NUM_DIM + CHZ] = grz;
+    /* publish the sample after it is written */
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    return 0;
+
+}
+
+
+/* Consumer side of the sample ring, called from the main loop. Passes all
+*  samples in the ring to the algorithm (step_algo_push, at most two
+*  contiguous bursts) and runs it as often as the sensor input buffer fills.
+*  Input: Pointer to the sample ring, pointer to the algo instance, pointer to
+*         the timestamp in sec of the last consumed sample (updated)
+*  Output: Number of samples consumed
+*/
+static unsigned int sample_ring_drain(sample_ring_t *ring, step_algo_t *algo, float *timestamp)
+{
+    static const fifo_desc_t  desc = { FIFO_FLOAT, NUM_SENS_AXES, 1.0f, 1.0f };
+    unsigned int  tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned int  head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    unsigned int  num_samp = head - tail;
+    unsigned int  first, len, i;
+
+    while (tail != head) {
+        first = tail % SAMPLE_RING_LEN;
+        len = SAMPLE_RING_LEN - first;
+        if (len > head - tail)
+            len = head - tail;
+        step_algo_push(algo, &desc, ring->data[first], len, *timestamp + SENSOR_SAMP_INTVL);
+        for (i = 0; i < len; i++)
+            *timestamp += SENSOR_SAMP_INTVL;
+        tail += len;
+    }
+    /* release the slots after they are read */
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+    return num_samp;
+
+}
+
+
+/* The main algorithm, processes the sensor input data in sensor input buffer
+*  stored by preproc function to detect step type and estimate step count.
+*  The algorithm estimates frequency and amplitude of the accel y-axis data
+*  by finding max and min values.
+*  Max and min values have derivate of 0, thus a lead-lag filter is used to
+*  take derivative of the input data. The zero-crossings of derivative data
+*  provides max and min values of input data.
+*  The  zero crossing is computed by finding points where the data changes sign.
+*  Input: Pointer to the algo instance
+*  Output: None
+*/
+static void step_algo_run(step_algo_t *algo)
+{
+    step_algo_run_block(algo, SAMP_BUFF_LEN);
+
+}
+
+
+/* Process a partial sensor input buffer, e.g. the trailing samples at the end
+*  of a file or the samples of a stalled stream. The samples carried over to
+*  the next run (TC_samples) are kept consistent, so streaming can continue
+*  with full buffers after a flush.
+*  Input: Pointer to the algo instance
+*  Output: Number of samples processed
+*/
+static unsigned int step_algo_finalize(step_algo_t *algo)
+{
+    unsigned int  num_samp = algo->AccBuffCount;
+
+    if (num_samp > 0) {
+        step_algo_run_block(algo, num_samp);
+        algo->AccBuffCount = 0;
+    }
+
+    return num_samp;
+
+}
+
+
+/* Timeout driven flush for streaming input with a sample clock, processes
+*  the partially filled sensor input buffer if no sample has been received
+*  for STREAM_FLUSH_TIMEOUT_SAMP sample intervals. Counted in samples, as
+*  float times summed per sample drift from the clock on long streams.
+*  Input: Pointer to the algo instance, samples due by now on the sample
+*         clock since the reset (same count as algo->tick)
+*  Output: Number of samples processed
+*/
+static unsigned int step_algo_poll(step_algo_t *algo, unsigned int now_tick)
+{
+    if ((algo->AccBuffCount > 0) && (now_tick >= algo->tick + STREAM_FLUSH_TIMEOUT_SAMP))
+        return step_algo_finalize(algo);
+
+    return 0;
+
+}
+
+
+/* Run the algorithm on the first num_samp samples of the sensor input buffer
+*  Input: Pointer to the algo instance, number of samples (1..SAMP_BUFF_LEN)
+*  Output: None
+*/
+static void step_algo_run_block(step_algo_t *algo, unsigned int num_samp)
+{
+    /* Local Variables */
+    unsigned int         i;
+    unsigned int         TC_samples = 0;
+    unsigned int         num_zc = 0;
+    unsigned int         zc_idx[SAMP_BUFF_LEN];
+    float                *AccDer;
+    float                *AccFilt = algo->AccFilt;
+
+    /* Delay between derivative and filtered data due to  */
+    /* derivate (lead0lag) fiter delay                    */
+    TC_samples = algo->ll_filter_y.TC_samples;
+
+#if defined(STEP_ALGO_MIN_RAM)
+    if (algo->sos_filter_y.num_sect > 0)
+        apply_sos_filter_block(&algo->sos_filter_y, algo->AccBuffY, algo->AccBuffY, num_samp);
+
+    /* The derivative replaces the filtered data in the input buffer */
+    AccDer = algo->AccBuffY;
+    for (i = 0; i < num_samp; i++) {
+        AccFilt[TC_samples + i] = algo->AccBuffY[i];
+        AccDer[i] = apply_filter(&algo->ll_filter_y, AccFilt[TC_samples + i]);
+    }
+
+    OPS_COUNT(OPS_RUN, OPS_MEM, 3 * num_samp + 2 * TC_samples);
+    num_zc = step_algo_find_zc(AccDer, algo->prevAccDer, num_samp, zc_idx);
+
+    /* AccFilt[0] is the sample TC_samples + num_samp - 1 before the last one */
+    step_algo_detect(&algo_cfg_default, &algo->out, AccDer, AccFilt, NULL,
+                     ((float)algo->tick - (TC_samples + num_samp - 1)) * SENSOR_SAMP_INTVL,
+                     NULL, zc_idx, num_zc, NULL);
+
+    for (i = 0; i < TC_samples; i++)
+        AccFilt[i] = AccFilt[num_samp + i];
+#else
+    float                *TimeStamps = algo->TimeStamps;
+    float                *GyroFilt = algo->GyroFilt;
+    block_feat_t         feat;
+
+    /* Orientation independent input, replace raw data by the magnitude */
+    if (InputMode == INPUT_ACC_MAG)
+        acc_mag_preproc(&algo->GravBaseline, algo->AccBuffX, algo->AccBuffY, algo->AccBuffZ, num_samp);
+    if ((InputMode == INPUT_ACC_MAG) || (algo->sos_filter_y.num_sect > 0))
+        lp_filter_block(&algo->lp_filter_y, &algo->sos_filter_y, algo->AccBuffY, num_samp);
+
+    AccDer = algo->AccDer;
+    for (i = 0; i < num_samp; i++) {
+        /* Compute the derivative of filtered Y-axis Acc Data  */
+        AccDer[i] = apply_filter(&algo->ll_filter_y, algo->AccBuffY[i]);
+        /* AccFilt and TimeStamps are extended buffers to save */
+        /* prev TC_samples along with new Y-axis Acc Data      */
+        AccFilt[TC_samples + i] = algo->AccBuffY[i];
+        TimeStamps[TC_samples + i] = algo->AccBuffTs[i];
+        GyroFilt[TC_samples + i] = algo->GyroBuff[i];
+    }
+
+    OPS_COUNT(OPS_RUN, OPS_MEM, 7 * num_samp + 6 * TC_samples);
+
+    /* Locate the zero crossings of the derivative, these are the only */
+    /* samples where a new max or min value can be found               */
+    num_zc = step_algo_find_zc(AccDer, algo->prevAccDer, num_samp, zc_idx);
+
+    if ((algo->feat_sink != NULL) || (UseModel == 1))
+        extract_block_features(algo->RawBuff, num_samp, &feat);
+
+    step_algo_detect(&algo_cfg_default, &algo->out, AccDer, AccFilt, TimeStamps, 0.0f,
+                     (GyroValidate == 1) ? GyroFilt : NULL, zc_idx, num_zc,
+                     (UseModel == 1) ? &feat : NULL);
+
+    /* Save the last TC_samples for next run, for a short block */
+    /* some of them are still from the previous run             */
+    for (i = 0; i < TC_samples; i++) {
+        AccFilt[i] = AccFilt[num_samp + i];
+        TimeStamps[i] = TimeStamps[num_samp + i];
+        GyroFilt[i] = GyroFilt[num_samp + i];
+    }
+
+    if (algo->feat_sink != NULL) {
+        feat.timestamp = algo->AccBuffTs[num_samp-1];
+        feat.step_count = algo->out.step_count;
+        feat.step_type = algo->out.step_type;
+        feat.amp_est = algo->out.prev_amp_est;
+        feat.freq_est = algo->out.prev_freq_est;
+        algo->feat_sink(algo->feat_arg, &feat);
+    }
+#endif
+    /* Step min samples: index i of the run buffers is the stream sample */
+    /* tick - (TC_samples + num_samp) + i, counted from the reset        */
+    for (i = 0; (i < algo->out.num_block_steps) && (i < MAX_BLOCK_STEPS); i++) {
+        if (algo->tick + algo->out.block_step_samp[i] >= TC_samples + num_samp)
+            algo->out.block_step_samp[i] += algo->tick - (TC_samples + num_samp);
+        else
+            algo->out.block_step_samp[i] = 0;
+    }
+
+    /* Save selected algo data for the next run */
+    algo->prevAccDer = AccDer[num_samp-1];
+
+}
+
+
+/* Find the rising and falling zero crossings of the derivative of Acc Data
+*  A falling zero crossing (max of Acc Data) is where the derivative goes from
+*  >= 0 to < -EPSILON, a rising one (min of Acc Data) from <= 0 to > EPSILON.
+*  Input: Derivative data, last derivative value of the previous block,
+*         number of samples, array to store the zero crossing indices
+*  Output: Number of zero crossings found
+*/
+static unsigned int step_algo_find_zc(const float *AccDer, float prevAccDer, unsigned int len, unsigned int *zc_idx)
+{
+    /* counted as the scalar reference, up to 4 compares per sample */
+    OPS_COUNT(OPS_RUN, OPS_CMP, 4 * len);
+    OPS_COUNT(OPS_RUN, OPS_MEM, len);
+    return SimdKernels->find_zc(AccDer, prevAccDer, len, zc_idx);
+
+}
+
+
+/* Scalar reference implementation of step_algo_find_zc
+*  Input: Derivative data, last derivative value of the previous block,
+*         number of samples, array to store the zero crossing indices
+*  Output: Number of zero crossings found
+*/
+static unsigned int step_algo_find_zc_scalar(const float *AccDer, float prevAccDer, unsigned int len, unsigned int *zc_idx)
+{
+    unsigned int  i;
+    unsigned int  num_zc = 0;
+
+    for (i = 0; i < len; i++) {
+        if (i > 0)
+            prevAccDer = AccDer[i-1];
+
+        if ( ((AccDer[i] < -EPSILON) && (prevAccDer >= 0.0f)) ||
+             ((AccDer[i] > EPSILON) && (prevAccDer <= 0.0f)) ) {
+            zc_idx[num_zc] = i;
+            num_zc = num_zc + 1;
+        }
+    }
+
+    return num_zc;
+
+}
+
+
+#if defined(__SSE2__)
+/* SSE2 implementation of step_algo_find_zc
+*  Compares 4 samples against their predecessors at once and turns the sign
+*  changes into a bitmask, so only the zero crossings themselves are visited.
+*  The compares are done against the float next above EPSILON with >= and <=,
+*  which gives exactly the same result as the scalar > and < against the
+*  double EPSILON.
+*  Input: Derivative data, last derivative value of the previous block,
+*         number of samples, array to store the zero crossing indices
+*  Output: Number of zero crossings found
+*/
+static unsigned int step_algo_find_zc_sse2(const float *AccDer, float prevAccDer, unsigned int len, unsigned int *zc_idx)
+{
+    const float   eps = nextafterf((float)EPSILON, 1.0f);
+    const __m128  pos_eps = _mm_set1_ps(eps);
+    const __m128  neg_eps = _mm_set1_ps(-eps);
+    const __m128  zero = _mm_setzero_ps();
+    __m128        cur, prev, fall, rise;
+    unsigned int  i = 0, num_zc = 0;
+    int           mask;
+
+    if (len >= 4) {
+        /* first vector takes its previous sample from the previous block */
+        prev = _mm_set_ps(AccDer[2], AccDer[1], AccDer[0], prevAccDer);
+        for (i = 0; i + 4 <= len; i += 4) {
+            if (i > 0)
+                prev = _mm_loadu_ps(AccDer + i - 1);
+            cur = _mm_loadu_ps(AccDer + i);
+            fall = _mm_and_ps(_mm_cmple_ps(cur, neg_eps), _mm_cmpge_ps(prev, zero));
+            rise = _mm_and_ps(_mm_cmpge_ps(cur, pos_eps), _mm_cmple_ps(prev, zero));
+            mask = _mm_movemask_ps(_mm_or_ps(fall, rise));
+            while (mask != 0) {
+                zc_idx[num_zc] = i + (unsigned int)__builtin_ctz(mask);
+                num_zc = num_zc + 1;
+                mask = mask & (mask - 1);
+            }
+        }
+    }
+
+    /* remaining samples */
+    if (i < len) {
+        unsigned int  k = num_zc;
+
+        num_zc += step_algo_find_zc_scalar(AccDer + i, (i > 0) ? AccDer[i-1] : prevAccDer, len - i, zc_idx + num_zc);
+        for (; k < num_zc; k++)
+            zc_idx[k] += i;
+    }
+
+    return num_zc;
+
+}
+#endif
+
+
+#if defined(STEP_ALGO_AVX2)
+/* AVX2 implementation of step_algo_find_zc, as the SSE2 one with 8 samples
+*  per compare
+*  Input: Derivative data, last derivative value of the previous block,
+*         number of samples, array to store the zero crossing indices
+*  Output: Number of zero crossings found
+*/
+__attribute__((target("avx2")))
+static unsigned int step_algo_find_zc_avx2(const float *AccDer, float prevAccDer, unsigned int len, unsigned int *zc_idx)
+{
+    const float   eps = nextafterf((float)EPSILON, 1.0f);
+    const __m256  pos_eps = _mm256_set1_ps(eps);
+    const __m256  neg_eps = _mm256_set1_ps(-eps);
+    const __m256  zero = _mm256_setzero_ps();
+    __m256        cur, prev, fall, rise;
+    unsigned int  i = 0, num_zc = 0;
+    int           mask;
+
+    if (len >= 8) {
+        /* first vector takes its previous sample from the previous block */
+        prev = _mm256_set_ps(AccDer[6], AccDer[5], AccDer[4], AccDer[3], AccDer[2], AccDer[1], AccDer[0], prevAccDer);
+        for (i = 0; i + 8 <= len; i += 8) {
+            if (i > 0)
+                prev = _mm256_loadu_ps(AccDer + i - 1);
+            cur = _mm256_loadu_ps(AccDer + i);
+            fall = _mm256_and_ps(_mm256_cmp_ps(cur, neg_eps, _CMP_LE_OQ), _mm256_cmp_ps(prev, zero, _CMP_GE_OQ));
+            rise = _mm256_and_ps(_mm256_cmp_ps(cur, pos_eps, _CMP_GE_OQ), _mm256_cmp_ps(prev, zero, _CMP_LE_OQ));
+            mask = _mm256_movemask_ps(_mm256_or_ps(fall, rise));
+            while (mask != 0) {
+                zc_idx[num_zc] = i + (unsigned int)__builtin_ctz(mask);
+                num_zc = num_zc + 1;
+                mask = mask & (mask - 1);
+            }
+        }
+    }
+
+    /* remaining samples, clear the upper halves first so the SSE2 code */
+    /* does not pay the AVX to SSE transition on every instruction      */
+    if (i < len) {
+        unsigned int  k = num_zc;
+
+        _mm256_zeroupper();
+        num_zc += step_algo_find_zc_sse2(AccDer + i, (i > 0) ? AccDer[i-1] : prevAccDer, len - i, zc_idx + num_zc);
+        for (; k < num_zc; k++)
+            zc_idx[k] += i;
+    }
+
+    return num_zc;
+
+}
+#endif
+
+
+/* Step detection state machine, runs over the zero crossings of one block of
+*  derivative data and updates step count, step type and motion estimates.
+*  This only depends on the filtered data and the algo thresholds, so the same
+*  filtered block can be evaluated against many configurations.
+*  If filtered gyro energy is given, zero crossings without a matching rotation
+*  (energy outside gyro_min_energy..gyro_max_energy) are rejected: too little
+*  rotation is a tap or vibration, too much is arm motion rather than a step.
+*  Input: Algo configuration, pointer to the algo output data, derivative,
+*         filtered data, timestamps (or NULL, sample i is then at ts0 + i *
+*         SENSOR_SAMP_INTVL sec) and filtered gyro energy (or NULL) of the
+*         block (delayed by TC_samples), zero crossing indices and their count,
+*         block features to classify with the compiled model (NULL to use the
+*         thresholds of cfg)
+*  Output: Number of steps detected in this block
+*/
+static unsigned int step_algo_detect(const algo_cfg_t *cfg, algo_out_t *step_algo_output, const float *AccDer,
+                                     const float *AccFilt, const float *TimeStamps, float ts0, const float *GyroFilt,
+                                     const unsigned int *zc_idx, unsigned int num_zc, block_feat_t *feat)
+{
+    /* Local Variables */
+    unsigned int         i, k;
+    float                ts;
+    float                prev_max_val, prev_max_ts, prev_min_val, prev_min_ts;
+    float                new_max_val, new_max_ts, new_min_val, new_min_ts;
+    float                avg_max_val = 0.0f, avg_min_val = 0.0f, avg_time_period = 0.0f;
+    float                freq_est = 0.0f, amp_est = 0.0f;
+    unsigned int         count_max_det = 0, count_min_det = 0;
+
+    /* Initialize variables */
+    new_max_val = -VERY_HIGH_VAL;
+    new_min_val = VERY_HIGH_VAL;
+    new_max_ts = 0.0f;
+    new_min_ts = 0.0f;
+
+    /* Prev max and min values and their timestamps are   */
+    /* needed to estimate one step in cases where data for*/
+    /* one step span accross multiple calls to this algo  */
+    prev_max_val = step_algo_output->prev_max;
+    prev_max_ts = step_algo_output->prev_max_ts;
+    prev_min_val = step_algo_output->prev_min;
+    prev_min_ts = step_algo_output->prev_min_ts;
+
+    /* Find the new max/min values of Filtered Y-axis Acc Data and timestamp             */
+    /* This is done by detecting rising/falling zero crossings in derivative of Acc Data */
+    for (k = 0; k < num_zc; k++) {
+        i = zc_idx[k];
+        OPS_COUNT(OPS_RUN, OPS_CMP, (GyroFilt != NULL) ? 5 : 3);
+        OPS_COUNT(OPS_RUN, OPS_MEM, (GyroFilt != NULL) ? 4 : 3);
+
+        if ((GyroFilt != NULL) &&
+            ((GyroFilt[i] < cfg->gyro_min_energy) || (GyroFilt[i] > cfg->gyro_max_energy)))
+            continue;
+        ts = (TimeStamps != NULL) ? TimeStamps[i] : ts0 + i * SENSOR_SAMP_INTVL;
+
+        if (prev_max_ts <= prev_min_ts) {
+            /* need to find the next max val(falling ZC) */
+            if (AccDer[i] < 0.0f) {
+                /* Avoid searching very close to already found max value */
+                if (ts - prev_max_ts > cfg->no_detect_dur) {
+                    new_max_val = AccFilt[i];
+                    if (fabs(new_max_val) > cfg->close_to_zero) {
+                        new_max_ts = ts;
+                        /* Clamp diff betweeen new_max_ts and prev_max_ts to avoid */
+                        /* distortion in estimation of step frequency              */
+                        if (new_max_ts > prev_max_ts + cfg->max_time_period)
+                            prev_max_ts = new_max_ts - cfg->max_time_period;
+                        /* Avoid max vlaue which is very close to prev min value   */
+                        if (new_max_val - prev_min_val > cfg->close_to_zero) {
+                            OPS_COUNT(OPS_RUN, OPS_MAC, 5);
+                            OPS_COUNT(OPS_RUN, OPS_CMP, 4);
+                            OPS_COUNT(OPS_RUN, OPS_MEM, 2);
+                            avg_time_period = avg_time_period + (new_max_ts - prev_max_ts);
+                            avg_max_val = avg_max_val + new_max_val;
+                            count_max_det = count_max_det + 1;
+                            prev_max_ts = new_max_ts;
+                            prev_max_val = new_max_val;
+                        }
+                    }
+                }
+            }
+        }
+        else {
+            /* need to find the next min val(rising ZC) */
+            if (AccDer[i] > 0.0f) {
+                /* Avoid searching very close to already found min value */
+                if (ts - prev_min_ts > cfg->no_detect_dur) {
+                    new_min_val = AccFilt[i];
+                    new_min_ts = ts;
+                    /* Clamp diff betweeen new_max_ts and prev_max_ts to avoid */
+                    /* distortion in estimation of step frequency              */
+                    if (new_min_ts > prev_min_ts + cfg->max_time_period)
+                        prev_min_ts = new_min_ts - cfg->max_time_period;
+                    /* Avoid min vlaue which is very close to prev max value   */
+                    if (prev_max_val - new_min_val > cfg->close_to_zero) {
+                        OPS_COUNT(OPS_RUN, OPS_MAC, 6);
+                        OPS_COUNT(OPS_RUN, OPS_CMP, 3);
+                        OPS_COUNT(OPS_RUN, OPS_MEM, 2);
+                        avg_time_period = avg_time_period + (new_min_ts - prev_min_ts);
+                        avg_min_val = avg_min_val + new_min_val;
+                        amp_est += prev_max_val - new_min_val;
+                        /* A pair of max and min is one step and is equal to   */
+                        /* the value of count_min_det                          */
+                        /* index in the run buffers, see step_algo_run_block */
+                        if (count_min_det < MAX_BLOCK_STEPS)
+                            step_algo_output->block_step_samp[count_min_det] = i;
+                        count_min_det = count_min_det + 1;
+                        prev_min_ts = new_min_ts;
+                        prev_min_val = new_min_val;
+                    }
+                }
+            }
+        }
+    }
+
+    /* amp and freq estimates and algo output update */
+    OPS_COUNT(OPS_RUN, OPS_DIV, 3);
+    OPS_COUNT(OPS_RUN, OPS_CMP, 6);
+    OPS_COUNT(OPS_RUN, OPS_MEM, 16);
+    if (count_min_det > 0) {
+        amp_est = amp_est / count_min_det;
+        step_algo_output->amp_est_hold = 0;
+    }
+    else {
+        amp_est = step_algo_output->prev_amp_est;
+        step_algo_output->amp_est_hold++;
+    }
+    if( step_algo_output->amp_est_hold > BUFF_FACTOR ) {
+        step_algo_output->amp_est_hold = 0;
+        amp_est = 0.0f;
+    }
+
+    if (count_max_det + count_min_det > 0) {
+        avg_time_period = avg_time_period / (count_max_det + count_min_det);
+    }
+    if (avg_time_period > EPSILON) {
+        freq_est = 1 / avg_time_period;
+        step_algo_output->freq_est_hold = 0;
+    }
+    else {
+        freq_est = step_algo_output->prev_freq_est;
+        step_algo_output->freq_est_hold++;
+    }
+    if( step_algo_output->freq_est_hold > BUFF_FACTOR ) {
+        step_algo_output->freq_est_hold = 0;
+        freq_est = 0.0f;
+    }
+
+    /* Save selected algo data for the next run */
+    step_algo_output->prev_amp_est = amp_est;
+    step_algo_output->prev_freq_est = freq_est;
+
+    /* Update the algo output */
+    step_algo_output->prev_max = prev_max_val;
+    step_algo_output->prev_max_ts = prev_max_ts;
+    step_algo_output->prev_min = prev_min_val;
+    step_algo_output->prev_min_ts = prev_min_ts;
+    step_algo_output->step_count += count_min_det;
+    step_algo_output->num_block_steps = count_min_det;
+    if (feat != NULL) {
+        feat->amp_est = amp_est;
+        feat->freq_est = freq_est;
+        step_algo_output->step_type = classify_motion_model(feat);
+    }
+    else
+        step_algo_output->step_type = classify_motion(cfg, amp_est, freq_est);
+    /* Steps detected while STATIONARY are not accounted to any motion type */
+    if (step_algo_output->step_type != STATIC)
+        step_algo_output->type_steps[step_algo_output->step_type] += count_min_det;
+
+    return count_min_det;
+
+}
+
+
+/* Classify the motion type from the estimated amplitude and frequency
+*  Input: Algo configuration, estimated amplitude and frequency
+*  Output: Motion type
+*/
+static motion_type_t classify_motion(const algo_cfg_t *cfg, float amp_est, float freq_est)
+{
+    OPS_COUNT(OPS_RUN, OPS_CMP, 3);
+    OPS_COUNT(OPS_RUN, OPS_MEM, 3);
+    if (amp_est <= cfg->small_amp) {
+        if (freq_est <= cfg->slow_freq)
+            /* STATIONARY */
+            return STATIC;
+        else
+            /* WALKING */
+            return WALK;
+    }
+    else if (amp_est >= cfg->large_amp) {
+        if (freq_est >= cfg->fast_freq)
+            /* RUNNING */
+            return RUN;
+        else
+            /* HOPPINNG */
+            return HOP;
+    }
+    else {
+        if (freq_est >= cfg->fast_freq)
+            /* RUNNING */
+            return RUN;
+        else
+            /* WALKING */
+            return WALK;
+    }
+
+}
+
+
+/* Classify the motion type with the compiled tree model (motion_model.h)
+*  Every tree is a complete binary tree of depth MODEL_DEPTH stored as flat
+*  arrays, so evaluation is MODEL_DEPTH branchless steps per tree; the class
+*  with the highest sum of leaf scores over all trees wins.
+*  Input: Pointer to the block features (including amp_est and freq_est)
+*  Output: Motion type
+*/
+static motion_type_t classify_motion_model(const block_feat_t *feat)
+{
+    float         x[MODEL_NUM_FEATURES];
+    float         score[NUM_TYPES] = { 0 };
+    unsigned int  t, d, c, idx, best = 0;
+
+    model_features(feat, x);
+    OPS_COUNT(OPS_RUN, OPS_MEM, MODEL_NUM_FEATURES * 2);
+    OPS_COUNT(OPS_RUN, OPS_CMP, MODEL_NUM_TREES * MODEL_DEPTH + NUM_TYPES);
+    OPS_COUNT(OPS_RUN, OPS_MAC, MODEL_NUM_TREES * (MODEL_DEPTH * 2 + NUM_TYPES));
+    OPS_COUNT(OPS_RUN, OPS_MEM, MODEL_NUM_TREES * (MODEL_DEPTH * 3 + NUM_TYPES * 2));
+
+    for (t = 0; t < MODEL_NUM_TREES; t++) {
+        idx = 0;
+        for (d = 0; d < MODEL_DEPTH; d++)
+            idx = 2 * idx + 1 + (x[ModelFeature[t][idx]] > ModelThreshold[t][idx]);
+        idx = idx - MODEL_NUM_NODES;
+        for (c = 0; c < NUM_TYPES; c++)
+            score[c] += ModelLeaf[t][idx][c];
+    }
+    for (c = 1; c < NUM_TYPES; c++)
+        best = (score[c] > score[best]) ? c : best;
+
+    return (motion_type_t)best;
+
+}
+
+
+/* Flatten the block features into the model feature vector:
+*  0: amp_est, 1: freq_est, 2 + MODEL_FEAT_PER_AXIS * axis + j: feature j of
+*  axis (mean, var, energy, min, max, zcr, spec[0..NUM_SPEC_BINS-1])
+*  Input: Pointer to the block features, feature vector to fill
+*  Output: None
+*/
+static void model_features(const block_feat_t *feat, float *x)
+{
+    unsigned int  ax;
+
+    x[0] = feat->amp_est;
+    x[1] = feat->freq_est;
+    for (ax = 0; ax < NUM_SENS_AXES; ax++)
+        memcpy(&x[2 + MODEL_FEAT_PER_AXIS * ax], &feat->axis[ax], sizeof(axis_feat_t));
+
+}
+
+/* Preprocess a block of raw accelerometer data into the orientation independent
+*  channel |a| - g, where the gravity baseline g is tracked as a slow running
+*  mean of |a| updated once per block. The result is low pass filtered by the caller.
+*  Input: Pointer to gravity baseline, AccX, AccY, AccZ data (AccY is overwritten
+*         by the result), number of samples
+*  Output: None
+*/
+static void acc_mag_preproc(float *baseline, const float *arx, float *ary, const float *arz, unsigned int len)
+{
+    unsigned int  i;
+    float         mean = 0.0f;
+
+    acc_magnitude(arx, ary, arz, ary, len);
+    OPS_COUNT(OPS_RUN, OPS_MAC, 3 * len);   /* sum of squares */
+    OPS_COUNT(OPS_RUN, OPS_DIV, len);       /* sqrt */
+    OPS_COUNT(OPS_RUN, OPS_MEM, 4 * len);
+
+    OPS_COUNT(OPS_RUN, OPS_MAC, 2 * len + 2);
+    OPS_COUNT(OPS_RUN, OPS_DIV, 1);
+    OPS_COUNT(OPS_RUN, OPS_MEM, 3 * len);
+    for (i = 0; i < len; i++)
+        mean += ary[i];
+    mean = mean / len;
+    if (*baseline == GRAV_BASELINE_UNINIT)
+        *baseline = mean;
+    else
+        *baseline += GRAV_BASELINE_ALPHA * (mean - *baseline);
+
+    for (i = 0; i < len; i++)
+        ary[i] = ary[i] - *baseline;
+
+}
+
+
+/* Compute the magnitude sqrt(arx^2 + ary^2 + arz^2) of a block of accelerometer data
+*  Input: AccX, AccY, AccZ data, output array (may be one of the inputs), number of samples
+*  Output: None
+*/
+static void acc_magnitude(const float *arx, const float *ary, const float *arz, float *mag, unsigned int len)
+{
+    SimdKernels->acc_magnitude(arx, ary, arz, mag, len);
+
+}
+
+
+/* Scalar reference implementation of acc_magnitude
+*  Input: AccX, AccY, AccZ data, output array (may be one of the inputs), number of samples
+*  Output: None
+*/
+static void acc_magnitude_scalar(const float *arx, const float *ary, const float *arz, float *mag, unsigned int len)
+{
+    unsigned int  i;
+
+    for (i = 0; i < len; i++)
+        mag[i] = sqrtf(arx[i] * arx[i] + ary[i] * ary[i] + arz[i] * arz[i]);
+
+}
+
+
+#if defined(__SSE2__)
+/* SSE2 implementation of acc_magnitude
+*  The fast mode uses the approximate reciprocal square root with one
+*  Newton-Raphson step, |a| = s * rsqrt(s) with s = arx^2 + ary^2 + arz^2,
+*  which is accurate to a few ulp and much cheaper than a full precision
+*  square root. The bit-exact mode uses the correctly rounded square root,
+*  the same result as sqrtf.
+*  Input: AccX, AccY, AccZ data, output array (may be one of the inputs), number of samples
+*  Output: None
+*/
+static void acc_magnitude_sse2(const float *arx, const float *ary, const float *arz, float *mag, unsigned int len)
+{
+#if defined(STEP_ALGO_FAST_MATH)
+    const __m128  half = _mm_set1_ps(0.5f);
+    const __m128  three = _mm_set1_ps(3.0f);
+    const __m128  zero = _mm_setzero_ps();
+    __m128        r;
+#endif
+    __m128        x, y, z, sq;
+    unsigned int  i;
+
+    for (i = 0; i + 4 <= len; i += 4) {
+        x = _mm_loadu_ps(arx + i);
+        y = _mm_loadu_ps(ary + i);
+        z = _mm_loadu_ps(arz + i);
+        sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+#if defined(STEP_ALGO_FAST_MATH)
+        r = _mm_rsqrt_ps(sq);
+        /* r = 0.5 * r * (3 - sq * r * r) */
+        r = _mm_mul_ps(_mm_mul_ps(half, r), _mm_sub_ps(three, _mm_mul_ps(_mm_mul_ps(sq, r), r)));
+        /* sq * rsqrt(sq) is NaN for sq == 0, mask those lanes to 0 */
+        _mm_storeu_ps(mag + i, _mm_and_ps(_mm_mul_ps(sq, r), _mm_cmpgt_ps(sq, zero)));
+#else
+        _mm_storeu_ps(mag + i, _mm_sqrt_ps(sq));
+#endif
+    }
+
+    /* remaining samples */
+    if (i < len)
+        acc_magnitude_scalar(arx + i, ary + i, arz + i, mag + i, len - i);
+
+}
+#endif
+
+
+#if defined(STEP_ALGO_AVX2)
+/* AVX2 implementation of acc_magnitude, as the SSE2 one with 8 samples per
+*  step (no FMA, so the results equal those of the SSE2 kernel in both modes)
+*  Input: AccX, AccY, AccZ data, output array (may be one of the inputs), number of samples
+*  Output: None
+*/
+__attribute__((target("avx2")))
+static void acc_magnitude_avx2(const float *arx, const float *ary, const float *arz, float *mag, unsigned int len)
+{
+#if defined(STEP_ALGO_FAST_MATH)
+    const __m256  half = _mm256_set1_ps(0.5f);
+    const __m256  three = _mm256_set1_ps(3.0f);
+    const __m256  zero = _mm256_setzero_ps();
+    __m256        r;
+#endif
+    __m256        x, y, z, sq;
+    unsigned int  i;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        x = _mm256_loadu_ps(arx + i);
+        y = _mm256_loadu_ps(ary + i);
+        z = _mm256_loadu_ps(arz + i);
+        sq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+#if defined(STEP_ALGO_FAST_MATH)
+        r = _mm256_rsqrt_ps(sq);
+        r = _mm256_mul_ps(_mm256_mul_ps(half, r), _mm256_sub_ps(three, _mm256_mul_ps(_mm256_mul_ps(sq, r), r)));
+        _mm256_storeu_ps(mag + i, _mm256_and_ps(_mm256_mul_ps(sq, r), _mm256_cmp_ps(sq, zero, _CMP_GT_OQ)));
+#else
+        _mm256_storeu_ps(mag + i, _mm256_sqrt_ps(sq));
+#endif
+    }
+
+    /* remaining samples, see step_algo_find_zc_avx2 */
+    if (i < len) {
+        _mm256_zeroupper();
+        acc_magnitude_sse2(arx + i, ary + i, arz + i, mag + i, len - i);
+    }
+
+}
+#endif
+
+
+/* Select the SIMD kernels used by all algorithm instances, call once before
+*  processing starts
+*  Input: Variant name, "auto" for the best one the CPU supports
+*  Output: 0 on success, -1 if the variant is not built or not supported
+*/
+static int simd_select(const char *name)
+{
+    unsigned int  v;
+    int           found = -1;
+
+#if defined(STEP_ALGO_AVX2)
+    __builtin_cpu_init();
+#endif
+    for (v = 0; v < NUM_SIMD_VARIANTS; v++) {
+#if defined(STEP_ALGO_AVX2)
+        if ((strcmp(SimdVariants[v].name, "avx2") == 0) && !__builtin_cpu_supports("avx2"))
+            continue;
+#endif
+        /* variants are in order of preference, auto takes the last one supported */
+        if ((strcmp(name, "auto") == 0) || (strcmp(name, SimdVariants[v].name) == 0))
+            found = (int)v;
+    }
+    if (found < 0)
+        return -1;
+    SimdKernels = &SimdVariants[found];
+
+    return 0;
+
+}
+
+
+#if !defined(STEP_ALGO_MIN_RAM)
+/* Initialize the DFT tables of the spectral feature bins, bin k is at
+*  k * SENSOR_SAMP_FREQ / SAMP_BUFF_LEN Hz, once per process (SpecTablesOnce)
+*  Input: None
+*  Output: None
+*/
+static void init_spec_tables(void)
+{
+    unsigned int  k, n;
+
+    for (k = 0; k < NUM_SPEC_BINS; k++) {
+        for (n = 0; n < SAMP_BUFF_LEN; n++) {
+            SpecCos[k][n] = (float)cos(2.0 * M_PI * (k + 1) * n / SAMP_BUFF_LEN);
+            SpecSin[k][n] = (float)sin(2.0 * M_PI * (k + 1) * n / SAMP_BUFF_LEN);
+        }
+    }
+
+}
+
+
+/* Extract the feature vector of one block of raw sensor data, for all axes
+*  Input: Raw data of all axes, number of samples (1..SAMP_BUFF_LEN),
+*         pointer to the block features to fill (the algo output fields are
+*         left for the caller)
+*  Output: None
+*/
+static void extract_block_features(float raw[NUM_SENS_AXES][SAMP_BUFF_LEN], unsigned int len, block_feat_t *feat)
+{
+    unsigned int  ax;
+
+    memset(feat, 0, sizeof(*feat));
+    feat->num_samp = len;
+    for (ax = 0; ax < NUM_SENS_AXES; ax++) {
+        /* partial blocks (finalize) are rare, keep them on the reference path */
+        if (len == SAMP_BUFF_LEN)
+            SimdKernels->axis_features(raw[ax], len, &feat->axis[ax]);
+        else
+            extract_axis_features_scalar(raw[ax], len, &feat->axis[ax]);
+    }
+
+}
+
+
+/* Scalar reference implementation of the per axis features: mean, variance,
+*  energy (mean square), min, max, mean crossing rate and spectral bin amplitudes
+*  Input: Raw data of one axis, number of samples, pointer to the features to fill
+*  Output: None
+*/
+static void extract_axis_features_scalar(const float *data, unsigned int len, axis_feat_t *feat)
+{
+    unsigned int  i, k;
+    float         sum = 0.0f, sum_sq = 0.0f, min_val = data[0], max_val = data[0];
+    float         re[NUM_SPEC_BINS] = { 0 }, im[NUM_SPEC_BINS] = { 0 };
+    unsigned int  num_cross = 0;
+
+    for (i = 0; i < len; i++) {
+        sum += data[i];
+        sum_sq += data[i] * data[i];
+        if (data[i] < min_val)
+            min_val = data[i];
+        if (data[i] > max_val)
+            max_val = data[i];
+        for (k = 0; k < NUM_SPEC_BINS; k++) {
+            re[k] += data[i] * SpecCos[k][i];
+            im[k] += data[i] * SpecSin[k][i];
+        }
+    }
+
+    feat->mean = sum / len;
+    feat->energy = sum_sq / len;
+    feat->var = feat->energy - feat->mean * feat->mean;
+    if (feat->var < 0.0f)
+        feat->var = 0.0f;
+    feat->min = min_val;
+    feat->max = max_val;
+
+    for (i = 1; i < len; i++) {
+        if ((data[i] > feat->mean) != (data[i-1] > feat->mean))
+            num_cross++;
+    }
+    feat->zcr = (float)num_cross / len;
+
+    for (k = 0; k < NUM_SPEC_BINS; k++)
+        feat->spec[k] = 2.0f * sqrtf(re[k] * re[k] + im[k] * im[k]) / len;
+
+}
+
+
+#if defined(__SSE2__) && defined(STEP_ALGO_FAST_MATH)
+/* Horizontal sum of the 4 lanes */
+static float hsum_sse2(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+
+/* SSE2 implementation of the per axis features, moments, min/max and all
+*  spectral bins are accumulated 4 samples at a time in a single pass, the
+*  mean crossings are counted with compare and movemask. The sums are
+*  reassociated into 4 lanes, so this kernel is only used in the fast mode.
+*  Input: Raw data of one axis, number of samples, pointer to the features to fill
+*  Output: None
+*/
+static void extract_axis_features_sse2(const float *data, unsigned int len, axis_feat_t *feat)
+{
+    __m128        vsum = _mm_setzero_ps(), vsq = _mm_setzero_ps();
+    __m128        vmin = _mm_set1_ps(data[0]), vmax = _mm_set1_ps(data[0]);
+    __m128        vre[NUM_SPEC_BINS], vim[NUM_SPEC_BINS];
+    __m128        x, vmean, above, prev_above;
+    float         re[NUM_SPEC_BINS], im[NUM_SPEC_BINS], lanes[4];
+    float         sum, sum_sq, min_val, max_val;
+    unsigned int  i, k, num_cross = 0;
+
+    for (k = 0; k < NUM_SPEC_BINS; k++) {
+        vre[k] = _mm_setzero_ps();
+        vim[k] = _mm_setzero_ps();
+    }
+
+    for (i = 0; i + 4 <= len; i += 4) {
+        x = _mm_loadu_ps(data + i);
+        vsum = _mm_add_ps(vsum, x);
+        vsq = _mm_add_ps(vsq, _mm_mul_ps(x, x));
+        vmin = _mm_min_ps(vmin, x);
+        vmax = _mm_max_ps(vmax, x);
+        for (k = 0; k < NUM_SPEC_BINS; k++) {
+            vre[k] = _mm_add_ps(vre[k], _mm_mul_ps(x, _mm_loadu_ps(&SpecCos[k][i])));
+            vim[k] = _mm_add_ps(vim[k], _mm_mul_ps(x, _mm_loadu_ps(&SpecSin[k][i])));
+        }
+    }
+
+    sum = hsum_sse2(vsum);
+    sum_sq = hsum_sse2(vsq);
+    _mm_storeu_ps(lanes, vmin);
+    min_val = lanes[0];
+    for (k = 1; k < 4; k++)
+        min_val = (lanes[k] < min_val) ? lanes[k] : min_val;
+    _mm_storeu_ps(lanes, vmax);
+    max_val = lanes[0];
+    for (k = 1; k < 4; k++)
+        max_val = (lanes[k] > max_val) ? lanes[k] : max_val;
+    for (k = 0; k < NUM_SPEC_BINS; k++) {
+        re[k] = hsum_sse2(vre[k]);
+        im[k] = hsum_sse2(vim[k]);
+    }
+
+    /* remaining samples */
+    for (; i < len; i++) {
+        sum += data[i];
+        sum_sq += data[i] * data[i];
+        min_val = (data[i] < min_val) ? data[i] : min_val;
+        max_val = (data[i] > max_val) ? data[i] : max_val;
+        for (k = 0; k < NUM_SPEC_BINS; k++) {
+            re[k] += data[i] * SpecCos[k][i];
+            im[k] += data[i] * SpecSin[k][i];
+        }
+    }
+
+    feat->mean = sum / len;
+    feat->energy = sum_sq / len;
+    feat->var = feat->energy - feat->mean * feat->mean;
+    if (feat->var < 0.0f)
+        feat->var = 0.0f;
+    feat->min = min_val;
+    feat->max = max_val;
+
+    /* mean crossings between sample i-1 and i, for i = 1..len-1 */
+    vmean = _mm_set1_ps(feat->mean);
+    for (i = 1; i + 4 <= len; i += 4) {
+        above = _mm_cmpgt_ps(_mm_loadu_ps(data + i), vmean);
+        prev_above = _mm_cmpgt_ps(_mm_loadu_ps(data + i - 1), vmean);
+        num_cross += __builtin_popcount(_mm_movemask_ps(_mm_xor_ps(above, prev_above)));
+    }
+    for (; i < len; i++) {
+        if ((data[i] > feat->mean) != (data[i-1] > feat->mean))
+            num_cross++;
+    }
+    feat->zcr = (float)num_cross / len;
+
+    for (k = 0; k < NUM_SPEC_BINS; k++)
+        feat->spec[k] = 2.0f * sqrtf(re[k] * re[k] + im[k] * im[k]) / len;
+
+}
+#endif
+
+
+/* Write the header of the binary feature file, followed by one block_feat_t
+*  record per processed block (native byte order, all fields 4 bytes)
+*  Input: Feature file
+*  Output: None
+*/
+static void write_feat_header(FILE *fpfeat)
+{
+    unsigned int  header[5];
+
+    header[0] = FEAT_FILE_MAGIC;
+    header[1] = FEAT_FILE_VERSION;
+    header[2] = NUM_SENS_AXES;
+    header[3] = NUM_SPEC_BINS;
+    header[4] = sizeof(block_feat_t);
+    fwrite(header, sizeof(header), 1, fpfeat);
+
+}
+
+
+/* Feature sink of the binary feature file (--features), one record per block
+*  Input: Feature file, block features
+*  Output: None
+*/
+static void write_feat_record(void *arg, const block_feat_t *feat)
+{
+    fwrite(feat, sizeof(*feat), 1, (FILE *)arg);
+
+}
+#endif
+
+
+/* Apply second order filter on input data
+*  Update filter state for the next run
+*  During long stationary periods the output decays toward zero and would
+*  enter the subnormal range, where float math is 10-100x slower on x86, so
+*  outputs below FILTER_FLUSH_THRESHOLD are flushed to zero.
+*  Input: Pointer to filter state var, Input data to filter
+*  Output: Filtered data
+*/
+static float apply_filter(filter_t *filt_data, float in_data)
+{
+    float out_data;
+
+    /* compute new output */
+    out_data = (filt_data->b0 * in_data) + (filt_data->b1 * filt_data->prev_in) + (filt_data->b2 * filt_data->prev_prev_in) \
+        - (filt_data->a1 * filt_data->prev_out) - (filt_data->a2 * filt_data->prev_prev_out);
+    out_data = (fabsf(out_data) < FILTER_FLUSH_THRESHOLD) ? 0.0f : out_data;
+    OPS_COUNT(OPS_FILTER, OPS_MAC, 5);
+    OPS_COUNT(OPS_FILTER, OPS_CMP, 1);
+    OPS_COUNT(OPS_FILTER, OPS_MEM, 13);   /* 5 coefficients, 4 state loads and stores */
+
+    /* update state of filter */
+    filt_data->prev_prev_in = filt_data->prev_in;
+    filt_data->prev_in = in_data;
+    filt_data->prev_prev_out = filt_data->prev_out;
+    filt_data->prev_out = out_data;
+
+    return out_data;
+
+}
+
+
+/* Design a Butterworth low pass or band pass filter as a cascade of 2nd order
+*  sections. The analog prototype poles are placed on the unit circle, moved
+*  to the (prewarped) cut-off frequencies and mapped to z by the bilinear
+*  transform; each complex conjugate pole pair makes one section. Low pass
+*  sections have a double zero at z = -1 and unity gain at DC, band pass
+*  sections zeros at z = 1 and z = -1 and unity gain at the center frequency.
+*  An odd low pass order adds one 1st order section (b2 = a2 = 0).
+*  Input: Pointer to filter state var, filter type, order (low pass 1..2*MAX_SOS_SECTIONS,
+*         band pass 1..MAX_SOS_SECTIONS, giving 2*order poles), cut-off frequency
+*         (low pass) or lower and upper band edge (band pass) in Hz
+*  Output: 0 on success, -1 for an invalid design
+*/
+static int design_sos_filter(sos_filter_t *filt_data, sos_type_t type, unsigned int order, float f1, float f2)
+{
+    const double  fs2 = 2.0 * SENSOR_SAMP_FREQ;
+    double complex p, s, z, r, ejw;
+    double        wc, w1, w2, w0, bw, theta, g;
+    unsigned int  j, k, num_sect = 0;
+    float         *c;
+
+    if ((f1 <= 0.0f) || (f1 >= 0.5f * SENSOR_SAMP_FREQ) || (order == 0))
+        return -1;
+
+    if (type == SOS_LOWPASS) {
+        if (order > 2 * MAX_SOS_SECTIONS)
+            return -1;
+        wc = fs2 * tan(M_PI * f1 / SENSOR_SAMP_FREQ);
+        for (k = 0; k < order / 2; k++) {
+            theta = M_PI * (2 * k + order + 1) / (2.0 * order);
+            p = wc * cexp(I * theta);
+            z = (fs2 + p) / (fs2 - p);
+            c = filt_data->coef[num_sect++];
+            c[3] = (float)(-2.0 * creal(z));
+            c[4] = (float)(creal(z) * creal(z) + cimag(z) * cimag(z));
+            g = (1.0 - 2.0 * creal(z) + creal(z) * creal(z) + cimag(z) * cimag(z)) / 4.0;
+            c[0] = (float)g;
+            c[1] = (float)(2.0 * g);
+            c[2] = (float)g;
+        }
+        if (order % 2 == 1) {
+            /* real pole at -wc */
+            z = (fs2 - wc) / (fs2 + wc);
+            c = filt_data->coef[num_sect++];
+            g = (1.0 - creal(z)) / 2.0;
+            c[0] = (float)g;
+            c[1] = (float)g;
+            c[2] = 0.0f;
+            c[3] = (float)(-creal(z));
+            c[4] = 0.0f;
+        }
+    }
+    else {
+        if ((order > MAX_SOS_SECTIONS) || (f2 <= f1) || (f2 >= 0.5f * SENSOR_SAMP_FREQ))
+            return -1;
+        w1 = fs2 * tan(M_PI * f1 / SENSOR_SAMP_FREQ);
+        w2 = fs2 * tan(M_PI * f2 / SENSOR_SAMP_FREQ);
+        bw = w2 - w1;
+        w0 = sqrt(w1 * w2);
+        ejw = cexp(-I * 2.0 * atan(w0 / fs2));   /* z^-1 at the center frequency */
+        for (k = 0; k < order; k++) {
+            /* each prototype pole p maps to the roots of s^2 - p*bw*s + w0^2 */
+            theta = M_PI * (2 * k + order + 1) / (2.0 * order);
+            p = cexp(I * theta) * bw / 2.0;
+            r = csqrt(p * p - w0 * w0);
+            for (j = 0; j < 2; j++) {
+                s = (j == 0) ? (p + r) : (p - r);
+                z = (fs2 + s) / (fs2 - s);
+                if (cimag(z) > 0.0) {
+                    if (num_sect == order)
+                        return -1;
+                    c = filt_data->coef[num_sect++];
+                    c[3] = (float)(-2.0 * creal(z));
+                    c[4] = (float)(creal(z) * creal(z) + cimag(z) * cimag(z));
+                    g = cabs((1.0 + c[3] * ejw + c[4] * ejw * ejw) / (1.0 - ejw * ejw));
+                    c[0] = (float)g;
+                    c[1] = 0.0f;
+                    c[2] = (float)(-g);
+                }
+            }
+        }
+        if (num_sect != order)
+            return -1;  /* band too wide, real poles */
+    }
+    filt_data->num_sect = num_sect;
+    reset_sos_filter(filt_data);
+
+    return 0;
+
+}
+
+
+/* Reset the state of a cascaded filter, the coefficients are kept
+*  Input: Pointer to filter state var
+*  Output: None
+*/
+static void reset_sos_filter(sos_filter_t *filt_data)
+{
+    memset(filt_data->state, 0, sizeof(filt_data->state));
+
+}
+
+
+/* Apply a cascaded filter to a block of data, all sections are evaluated
+*  per sample in one pass so the intermediate signals never leave registers
+*  Input: Pointer to filter state var, input data, output data (may be the
+*         input), number of samples
+*  Output: None
+*/
+static void apply_sos_filter_block(sos_filter_t *filt_data, const float *in_data, float *out_data, unsigned int len)
+{
+    unsigned int  i, s;
+    unsigned int  num_sect = filt_data->num_sect;
+    float         x, y;
+    const float   *c;
+    float         *w;
+
+    for (i = 0; i < len; i++) {
+        x = in_data[i];
+        for (s = 0; s < num_sect; s++) {
+            c = filt_data->coef[s];
+            w = filt_data->state[s];
+            /* w[0], w[1] are the prev inputs, w[2], w[3] the prev outputs */
+            y = (c[0] * x) + (c[1] * w[0]) + (c[2] * w[1]) - (c[3] * w[2]) - (c[4] * w[3]);
+            y = (fabsf(y) < FILTER_FLUSH_THRESHOLD) ? 0.0f : y;
+            OPS_COUNT(OPS_FILTER, OPS_MAC, 5);
+            OPS_COUNT(OPS_FILTER, OPS_CMP, 2);
+            OPS_COUNT(OPS_FILTER, OPS_MEM, 11);  /* 5 coefficients, 4 state loads, 2 stores */
+            w[1] = w[0];
+            w[0] = x;
+            x = y;
+        }
+        w = filt_data->state[num_sect];
+        w[1] = w[0];
+        w[0] = x;
+        out_data[i] = x;
+        OPS_COUNT(OPS_FILTER, OPS_MEM, 5);
+    }
+
+}
+
+
+/* Low pass filter a block of AccY data in place, with the cascaded filter if
+*  one is designed (--filter), with the default 2nd order filter otherwise
+*  Input: Pointer to the default filter state var, pointer to the cascaded
+*         filter state var, data, number of samples
+*  Output: None
+*/
+static void lp_filter_block(filter_t *filt_data, sos_filter_t *sos_data, float *data, unsigned int len)
+{
+    unsigned int  i;
+
+    if (sos_data->num_sect > 0)
+        apply_sos_filter_block(sos_data, data, data, len);
+    else {
+        for (i = 0; i < len; i++)
+            data[i] = apply_filter(filt_data, data[i]);
+    }
+
+}
+
+
+/* Parse the --filter option and design the cascaded filter
+*  Input: Option string lp:order:cutoff or bp:order:low:high (Hz), pointer to filter state var
+*  Output: 0 on success, -1 if invalid
+*/
+static int parse_filter_opt(const char *opt, sos_filter_t *filt_data)
+{
+    unsigned int  order;
+    float         f1, f2;
+
+    if (sscanf(opt, "lp:%u:%f", &order, &f1) == 2)
+        return design_sos_filter(filt_data, SOS_LOWPASS, order, f1, 0.0f);
+    if (sscanf(opt, "bp:%u:%f:%f", &order, &f1, &f2) == 3)
+        return design_sos_filter(filt_data, SOS_BANDPASS, order, f1, f2);
+
+    return -1;
+
+}
+
+
+/*
+  Parameter sweep mode
+
+  Tuning the thresholds in algo_cfg_t by re-running the CLI means re-parsing
+  and re-filtering the same input for every configuration. In sweep mode every
+  input file is parsed and passed through lp_filter_y and ll_filter_y once; the
+  filtered data, derivative and derivative zero crossings of every block
+  (the trailing partial block included, as step_algo_finalize does at the end
+  of a file) are cached, and the step detection state machine (step_algo_detect) is
+  then evaluated for all configurations over the shared data by a pool of
+  worker threads.
+
+  The config file has one configuration per line with the fields:
+  SMALL_AMP, LARGE_AMP, SLOW_FREQ, FAST_FREQ, NO_DETECT_DUR_SEC, CLOSE_TO_ZERO
+  Any field can be given as a range start:stop:step, a line with ranges expands
+  into all combinations. Lines starting with '#' are ignored.
+*/
+
+#define SWEEP_NUM_PARAMS      ( 6 )
+#define SWEEP_MAX_THREADS     ( 64 )
+
+/* Filtered data of one input file shared by all configurations */
+typedef struct {
+    const char    *fname;
+    unsigned int  num_blocks;   /* the last one may be partial */
+    float         *AccFilt;     /* TC_samples of zero padding + filtered data */
+    float         *TimeStamps;  /* TC_samples of zero padding + timestamps    */
+    float         *GyroFilt;    /* TC_samples of zero padding + gyro energy, NULL if not validated */
+    float         *AccDer;      /* derivative of filtered data                */
+    unsigned int  *zc_idx;      /* zero crossing indices (within block)       */
+    unsigned int  *zc_off;      /* first zero crossing of each block          */
+} sweep_data_t;
+
+/* Result of one configuration on one input file */
+typedef struct {
+    unsigned int  step_count;
+    unsigned int  type_steps[NUM_TYPES];
+} sweep_res_t;
+
+/* Work shared with the sweep worker threads */
+typedef struct {
+    const algo_cfg_t    *cfgs;
+    unsigned int        num_cfgs;
+    const sweep_data_t  *data;
+    unsigned int        num_files;
+    sweep_res_t         *res;       /* num_cfgs x num_files */
+    unsigned int        thread_id;
+    unsigned int        num_threads;
+} sweep_work_t;
+
+
+/* Parse and filter one input file and cache its zero crossings
+*  Input: Input file name, pointer to the sweep data to fill
+*  Output: 0 on success, -1 if the file cannot be read
+*/
+static int sweep_load(const char *fname, sweep_data_t *data)
+{
+    FILE          *fpin;
+    sens_data_t   sens_data;
+    filter_t      lp_filter, ll_filter, lp_filter_gyro;
+    sos_filter_t  sos_filter = SosFilterY;
+    float         timestamp = 0.0f;
+    float         prevAccDer = 0.0f;
+    unsigned int  num_samp = 0, max_samp = 1024;
+    unsigned int  TC_samples, i, b, len;
+    float         *filt, *ts, *gyro;
+    float         baseline = GRAV_BASELINE_UNINIT;
+    float         blk_x[SAMP_BUFF_LEN], blk_z[SAMP_BUFF_LEN];
+
+    fpin = fopen(fname, "r");
+    if (fpin == NULL)
+        return -1;
+    if (skip_header(fpin) != 0) {
+        fclose(fpin);
+        return -1;
+    }
+
+    init_lp_filter(&lp_filter);
+    init_ll_filter(&ll_filter);
+    init_lp_filter(&lp_filter_gyro);
+    reset_sos_filter(&sos_filter);
+    TC_samples = ll_filter.TC_samples;
+
+    filt = malloc((TC_samples + max_samp) * sizeof(float));
+    ts = malloc((TC_samples + max_samp) * sizeof(float));
+    gyro = malloc((TC_samples + max_samp) * sizeof(float));
+    if ((filt == NULL) || (ts == NULL) || (gyro == NULL)) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < TC_samples; i++) {
+        filt[i] = 0.0f;
+        ts[i] = 0.0f;
+        gyro[i] = 0.0f;
+    }
+
+    while (read_sens_data(fpin, &sens_data) == 0) {
+        if (num_samp == max_samp) {
+            max_samp = 2 * max_samp;
+            filt = realloc(filt, (TC_samples + max_samp) * sizeof(float));
+            ts = realloc(ts, (TC_samples + max_samp) * sizeof(float));
+            gyro = realloc(gyro, (TC_samples + max_samp) * sizeof(float));
+            if ((filt == NULL) || (ts == NULL) || (gyro == NULL)) {
+                printf("Out of memory\n");
+                exit(1);
+            }
+        }
+        timestamp += SENSOR_SAMP_INTVL;
+        if ((InputMode == INPUT_ACC_MAG) || (sos_filter.num_sect > 0)) {
+            /* filter block by block, same as step_algo_run */
+            blk_x[num_samp % SAMP_BUFF_LEN] = sens_data.arx;
+            blk_z[num_samp % SAMP_BUFF_LEN] = sens_data.arz;
+            filt[TC_samples + num_samp] = sens_data.ary;
+            if ((num_samp + 1) % SAMP_BUFF_LEN == 0) {
+                float *blk_y = filt + TC_samples + num_samp + 1 - SAMP_BUFF_LEN;
+
+                if (InputMode == INPUT_ACC_MAG)
+                    acc_mag_preproc(&baseline, blk_x, blk_y, blk_z, SAMP_BUFF_LEN);
+                lp_filter_block(&lp_filter, &sos_filter, blk_y, SAMP_BUFF_LEN);
+            }
+        }
+        else
+            filt[TC_samples + num_samp] = apply_filter(&lp_filter, sens_data.ary);
+        ts[TC_samples + num_samp] = timestamp;
+        gyro[TC_samples + num_samp] = apply_filter(&lp_filter_gyro,
+            sens_data.grx * sens_data.grx + sens_data.gry * sens_data.gry + sens_data.grz * sens_data.grz);
+        num_samp++;
+    }
+    fclose(fpin);
+    if (GyroValidate == 0) {
+        free(gyro);
+        gyro = NULL;
+    }
+    len = num_samp % SAMP_BUFF_LEN;
+    if ((len > 0) && ((InputMode == INPUT_ACC_MAG) || (sos_filter.num_sect > 0))) {
+        /* trailing partial block, filtered as by step_algo_finalize */
+        float *blk_y = filt + TC_samples + num_samp - len;
+
+        if (InputMode == INPUT_ACC_MAG)
+            acc_mag_preproc(&baseline, blk_x, blk_y, blk_z, len);
+        lp_filter_block(&lp_filter, &sos_filter, blk_y, len);
+    }
+
+    /* The trailing samples are processed as a short last block */
+    data->fname = fname;
+    data->num_blocks = (num_samp + SAMP_BUFF_LEN - 1) / SAMP_BUFF_LEN;
+    data->AccFilt = filt;
+    data->TimeStamps = ts;
+    data->GyroFilt = gyro;
+    data->AccDer = malloc((data->num_blocks * SAMP_BUFF_LEN + 1) * sizeof(float));
+    data->zc_idx = malloc((data->num_blocks * SAMP_BUFF_LEN + 1) * sizeof(unsigned int));
+    data->zc_off = malloc((data->num_blocks + 1) * sizeof(unsigned int));
+    if ((data->AccDer == NULL) || (data->zc_idx == NULL) || (data->zc_off == NULL)) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+
+    data->zc_off[0] = 0;
+    for (b = 0; b < data->num_blocks; b++) {
+        float *AccDer = data->AccDer + b * SAMP_BUFF_LEN;
+
+        len = (num_samp - b * SAMP_BUFF_LEN < SAMP_BUFF_LEN) ? num_samp - b * SAMP_BUFF_LEN : SAMP_BUFF_LEN;
+        for (i = 0; i < len; i++)
+            AccDer[i] = apply_filter(&ll_filter, filt[TC_samples + b * SAMP_BUFF_LEN + i]);
+        data->zc_off[b + 1] = data->zc_off[b] +
+            step_algo_find_zc(AccDer, prevAccDer, len, data->zc_idx + data->zc_off[b]);
+        prevAccDer = AccDer[len - 1];
+    }
+
+    return 0;
+
+}
+
+
+/* Sweep worker thread, evaluates every num_threads-th configuration on all files
+*  Input: Pointer to the sweep work
+*  Output: NULL
+*/
+static void *sweep_worker(void *arg)
+{
+    sweep_work_t        *work = (sweep_work_t *)arg;
+    algo_out_t          algo_out;
+    unsigned int        c, f, b;
+
+    for (c = work->thread_id; c < work->num_cfgs; c += work->num_threads) {
+        for (f = 0; f < work->num_files; f++) {
+            const sweep_data_t *data = &work->data[f];
+            sweep_res_t        *res = &work->res[c * work->num_files + f];
+
+            init_algo_out(&algo_out);
+            for (b = 0; b < data->num_blocks; b++) {
+                step_algo_detect(&work->cfgs[c], &algo_out,
+                    data->AccDer + b * SAMP_BUFF_LEN,
+                    data->AccFilt + b * SAMP_BUFF_LEN,
+                    data->TimeStamps + b * SAMP_BUFF_LEN, 0.0f,
+                    (data->GyroFilt != NULL) ? data->GyroFilt + b * SAMP_BUFF_LEN : NULL,
+                    data->zc_idx + data->zc_off[b], data->zc_off[b + 1] - data->zc_off[b], NULL);
+            }
+            res->step_count = algo_out.step_count;
+            memcpy(res->type_steps, algo_out.type_steps, sizeof(res->type_steps));
+        }
+    }
+
+    return NULL;
+
+}
+
+
+/* Parse one line of the sweep config file and append the expanded configurations
+*  Input: Config line, pointer to config array, its count and allocated size
+*  Output: 0 on success (or ignored line), -1 on parse error
+*/
+static int sweep_parse_cfg(char *line, algo_cfg_t **cfgs, unsigned int *num_cfgs, unsigned int *max_cfgs)
+{
+    float         start[SWEEP_NUM_PARAMS], stop[SWEEP_NUM_PARAMS], step[SWEEP_NUM_PARAMS];
+    unsigned int  num_val[SWEEP_NUM_PARAMS], pos[SWEEP_NUM_PARAMS];
+    unsigned int  p, total = 1, n;
+    char          *tok;
+
+    while ((*line == ' ') || (*line == '\t'))
+        line++;
+    if ((*line == '#') || (*line == '\n') || (*line == '\r') || (*line == '\0'))
+        return 0;
+
+    tok = strtok(line, ",");
+    for (p = 0; p < SWEEP_NUM_PARAMS; p++) {
+        if (tok == NULL)
+            return -1;
+        if (sscanf(tok, "%f:%f:%f", &start[p], &stop[p], &step[p]) == 3) {
+            if ((step[p] <= 0.0f) || (stop[p] < start[p]))
+                return -1;
+            num_val[p] = (unsigned int)((stop[p] - start[p]) / step[p] + EPSILON) + 1;
+        }
+        else if (sscanf(tok, "%f", &start[p]) == 1) {
+            step[p] = 0.0f;
+            num_val[p] = 1;
+        }
+        else
+            return -1;
+        total = total * num_val[p];
+        pos[p] = 0;
+        tok = strtok(NULL, ",");
+    }
+
+    for (n = 0; n < total; n++) {
+        algo_cfg_t  *cfg;
+        float       val[SWEEP_NUM_PARAMS];
+
+        if (*num_cfgs == *max_cfgs) {
+            *max_cfgs = 2 * (*max_cfgs) + 16;
+            *cfgs = realloc(*cfgs, *max_cfgs * sizeof(algo_cfg_t));
+            if (*cfgs == NULL) {
+                printf("Out of memory\n");
+                exit(1);
+            }
+        }
+        for (p = 0; p < SWEEP_NUM_PARAMS; p++)
+            val[p] = start[p] + pos[p] * step[p];
+
+        cfg = &(*cfgs)[*num_cfgs];
+        *cfg = algo_cfg_default;
+        cfg->small_amp = val[0];
+        cfg->large_amp = val[1];
+        cfg->slow_freq = val[2];
+        cfg->fast_freq = val[3];
+        cfg->no_detect_dur = val[4];
+        cfg->close_to_zero = val[5];
+        *num_cfgs = *num_cfgs + 1;
+
+        /* advance to the next combination, last param fastest */
+        for (p = SWEEP_NUM_PARAMS; p > 0; p--) {
+            if (++pos[p - 1] < num_val[p - 1])
+                break;
+            pos[p - 1] = 0;
+        }
+    }
+
+    return 0;
+
+}
+
+
+/* Parameter sweep entry point
+*  Input: Sweep arguments: [-j threads] configfile outputfile inputfile [inputfile ...]
+*  Output: Exit code
+*/
+static int run_sweep(int argc, char *argv[])
+{
+    FILE          *fpcfg, *fpout;
+    char          line_buff[MAX_CHAR_PER_LINE] = { 0 };
+    algo_cfg_t    *cfgs = NULL;
+    unsigned int  num_cfgs = 0, max_cfgs = 0;
+    sweep_data_t  *data;
+    sweep_res_t   *res;
+    unsigned int  num_files, num_threads = 0, c, f, t;
+    pthread_t     threads[SWEEP_MAX_THREADS];
+    sweep_work_t  work[SWEEP_MAX_THREADS];
+
+    if ((argc >= 2) && (strcmp(argv[0], "-j") == 0)) {
+        num_threads = (unsigned int)atoi(argv[1]);
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc < 3) {
+        printf("Usage: --sweep [-j threads] configfile outputfile inputfile [inputfile ...]\n");
+        return 1;
+    }
+    if (num_threads == 0) {
+        long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = (num_cpus > 0) ? (unsigned int)num_cpus : 1;
+    }
+    if (num_threads > SWEEP_MAX_THREADS)
+        num_threads = SWEEP_MAX_THREADS;
+
+    fpcfg = fopen(argv[0], "r");
+    if (fpcfg == NULL) {
+        printf("Cannot open config file: %s\n", argv[0]);
+        return 1;
+    }
+    while (NULL != fgets(line_buff, MAX_CHAR_PER_LINE, fpcfg)) {
+        if (sweep_parse_cfg(line_buff, &cfgs, &num_cfgs, &max_cfgs) != 0) {
+            printf("Invalid line in config file: %s\n", argv[0]);
+            return 1;
+        }
+    }
+    fclose(fpcfg);
+    if (num_cfgs == 0) {
+        printf("No configurations in config file: %s\n", argv[0]);
+        return 1;
+    }
+
+    fpout = fopen(argv[1], "w");
+    if (fpout == NULL) {
+        printf("Cannot open output file: %s\n", argv[1]);
+        return 1;
+    }
+
+    /* Parse and filter every input file once */
+    num_files = argc - 2;
+    data = calloc(num_files, sizeof(sweep_data_t));
+    res = calloc(num_cfgs * num_files, sizeof(sweep_res_t));
+    if ((data == NULL) || (res == NULL)) {
+        printf("Out of memory\n");
+        return 1;
+    }
+    for (f = 0; f < num_files; f++) {
+        if (sweep_load(argv[2 + f], &data[f]) != 0) {
+            printf("Cannot read input file: %s\n", argv[2 + f]);
+            return 1;
+        }
+    }
+
+    /* Evaluate all configurations over the shared data */
+    for (t = 0; t < num_threads; t++) {
+        work[t].cfgs = cfgs;
+        work[t].num_cfgs = num_cfgs;
+        work[t].data = data;
+        work[t].num_files = num_files;
+        work[t].res = res;
+        work[t].thread_id = t;
+        work[t].num_threads = num_threads;
+        if (pthread_create(&threads[t], NULL, sweep_worker, &work[t]) != 0) {
+            printf("Cannot create sweep thread\n");
+            return 1;
+        }
+    }
+    for (t = 0; t < num_threads; t++)
+        pthread_join(threads[t], NULL);
+
+    fprintf(fpout, "CONFIG, SMALL_AMP, LARGE_AMP, SLOW_FREQ, FAST_FREQ, NO_DETECT_DUR_SEC, CLOSE_TO_ZERO, FILE, step_count, total_steps, walk_steps, run_steps, hop_steps\n");
+    for (c = 0; c < num_cfgs; c++) {
+        for (f = 0; f < num_files; f++) {
+            sweep_res_t *r = &res[c * num_files + f];
+
+            fprintf(fpout, "%u, %f, %f, %f, %f, %f, %f, %s, %u, %u, %u, %u, %u\n",
+                c, cfgs[c].small_amp, cfgs[c].large_amp, cfgs[c].slow_freq, cfgs[c].fast_freq,
+                cfgs[c].no_detect_dur, cfgs[c].close_to_zero, data[f].fname, r->step_count,
+                r->type_steps[WALK] + r->type_steps[RUN] + r->type_steps[HOP],
+                r->type_steps[WALK], r->type_steps[RUN], r->type_steps[HOP]);
+        }
+    }
+    fclose(fpout);
+
+    printf("Evaluated %u configurations on %u files using %u threads.\n", num_cfgs, num_files, num_threads);
+    printf("Done.\n");
+
+    for (f = 0; f < num_files; f++) {
+        free(data[f].AccFilt);
+        free(data[f].TimeStamps);
+        free(data[f].GyroFilt);
+        free(data[f].AccDer);
+        free(data[f].zc_idx);
+        free(data[f].zc_off);
+    }
+    free(data);
+    free(res);
+    free(cfgs);
+
+    return 0;
+
+}
+
+
+/*
+  Tree model compiler
+
+  Reads a trained decision tree or gradient boosted tree ensemble over the
+  block features (see model_features) from a text file and writes it as flat
+  constant arrays (motion_model.h) that are compiled into the binary. Each tree
+  is padded to a complete binary tree of the depth of the deepest tree, so
+  that classify_motion_model evaluates every tree in a fixed number of
+  branchless steps.
+
+  Model file format, one item per line, '#' starts a comment:
+  tree                                    starts a new tree, its root is node 0
+  node <id> <feature> <threshold> <left> <right>
+                                          go to right if x[feature] > threshold
+  leaf <id> <STATIC> <WALK> <HOP> <RUN>   class scores, summed over all trees
+*/
+
+#define MODEL_MAX_TREES       ( 256 )
+#define MODEL_MAX_NODES       ( 1024 )    /* nodes per tree in the model file */
+#define MODEL_MAX_DEPTH       ( 12 )
+
+/* One node of a parsed tree */
+typedef struct {
+    unsigned int  used;
+    unsigned int  is_leaf;
+    unsigned int  feature;
+    float         threshold;
+    unsigned int  left, right;
+    float         score[NUM_TYPES];
+} model_node_t;
+
+/* Flattened complete tree */
+typedef struct {
+    unsigned int  feature[(1 << MODEL_MAX_DEPTH) - 1];
+    float         threshold[(1 << MODEL_MAX_DEPTH) - 1];
+    float         leaf[1 << MODEL_MAX_DEPTH][NUM_TYPES];
+} model_tree_t;
+
+
+/* Depth (number of decision levels) of the sub tree at node id
+*  Input: Nodes of the tree, node id, current level
+*  Output: Depth, or -1 if the tree is invalid or too deep
+*/
+static int model_depth(const model_node_t *nodes, unsigned int id, unsigned int level)
+{
+    int  dl, dr;
+
+    if ((id >= MODEL_MAX_NODES) || (nodes[id].used == 0) || (level > MODEL_MAX_DEPTH))
+        return -1;
+    if (nodes[id].is_leaf == 1)
+        return 0;
+
+    dl = model_depth(nodes, nodes[id].left, level + 1);
+    dr = model_depth(nodes, nodes[id].right, level + 1);
+    if ((dl < 0) || (dr < 0))
+        return -1;
+
+    return 1 + ((dl > dr) ? dl : dr);
+
+}
+
+
+/* Flatten the sub tree at node id into position pos of a complete tree of
+*  depth depth, a leaf above the last level is padded with nodes that always
+*  go left (threshold +inf)
+*  Input: Nodes of the tree, node id, position, current level, depth, flat tree
+*  Output: None
+*/
+static void model_flatten(const model_node_t *nodes, unsigned int id, unsigned int pos,
+                          unsigned int level, unsigned int depth, model_tree_t *tree)
+{
+    if (level == depth) {
+        memcpy(tree->leaf[pos - ((1 << depth) - 1)], nodes[id].score, sizeof(nodes[id].score));
+        return;
+    }
+
+    if (nodes[id].is_leaf == 1) {
+        tree->feature[pos] = 0;
+        tree->threshold[pos] = INFINITY;
+        model_flatten(nodes, id, 2 * pos + 1, level + 1, depth, tree);
+        model_flatten(nodes, id, 2 * pos + 2, level + 1, depth, tree);
+    }
+    else {
+        tree->feature[pos] = nodes[id].feature;
+        tree->threshold[pos] = nodes[id].threshold;
+        model_flatten(nodes, nodes[id].left, 2 * pos + 1, level + 1, depth, tree);
+        model_flatten(nodes, nodes[id].right, 2 * pos + 2, level + 1, depth, tree);
+    }
+
+}
+
+
+/* Print a float so that it is parsed back to exactly the same value
+*  Input: Output file, value
+*  Output: None
+*/
+static void model_print_float(FILE *fpout, float val)
+{
+    char  val_buff[32];
+
+    if (isinf(val)) {
+        fprintf(fpout, "%sINFINITY", (val < 0.0f) ? "-" : "");
+        return;
+    }
+
+    /* 9 significant digits round trip any float, keep it a float literal */
+    snprintf(val_buff, sizeof(val_buff), "%.9g", val);
+    if (strpbrk(val_buff, ".e") == NULL)
+        strcat(val_buff, ".0");
+    fprintf(fpout, "%sf", val_buff);
+
+}
+
+
+/* Model compiler entry point
+*  Input: Arguments: modelfile headerfile
+*  Output: Exit code
+*/
+static int run_compile_model(int argc, char *argv[])
+{
+    FILE          *fpin, *fpout;
+    char          line_buff[MAX_CHAR_PER_LINE] = { 0 };
+    char          *cmt;
+    model_node_t  *nodes;
+    model_tree_t  *trees;
+    unsigned int  num_trees = 0, depth = 1, num_nodes, t, n, c, id;
+    unsigned int  feature, left, right;
+    float         threshold, score[NUM_TYPES];
+    int           d;
+
+    if (argc != 2) {
+        printf("Usage: --compile-model modelfile headerfile\n");
+        return 1;
+    }
+
+    fpin = fopen(argv[0], "r");
+    if (fpin == NULL) {
+        printf("Cannot open model file: %s\n", argv[0]);
+        return 1;
+    }
+
+    nodes = calloc(MODEL_MAX_TREES * MODEL_MAX_NODES, sizeof(model_node_t));
+    trees = calloc(MODEL_MAX_TREES, sizeof(model_tree_t));
+    if ((nodes == NULL) || (trees == NULL)) {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    while (NULL != fgets(line_buff, MAX_CHAR_PER_LINE, fpin)) {
+        model_node_t *node;
+
+        cmt = strchr(line_buff, '#');
+        if (cmt != NULL)
+            *cmt = '\0';
+
+        if (strncmp(line_buff, "tree", 4) == 0) {
+            if (num_trees == MODEL_MAX_TREES) {
+                printf("Too many trees in model file: %s\n", argv[0]);
+                return 1;
+            }
+            num_trees++;
+        }
+        else if (sscanf(line_buff, " node %u %u %f %u %u", &id, &feature, &threshold, &left, &right) == 5) {
+            if ((num_trees == 0) || (id >= MODEL_MAX_NODES) || (feature >= MODEL_NUM_FEATURES)) {
+                printf("Invalid node in model file: %s", line_buff);
+                return 1;
+            }
+            node = &nodes[(num_trees - 1) * MODEL_MAX_NODES + id];
+            node->used = 1;
+            node->is_leaf = 0;
+            node->feature = feature;
+            node->threshold = threshold;
+            node->left = left;
+            node->right = right;
+        }
+        else if (sscanf(line_buff, " leaf %u %f %f %f %f", &id, &score[STATIC], &score[WALK], &score[HOP], &score[RUN]) == 5) {
+            if ((num_trees == 0) || (id >= MODEL_MAX_NODES)) {
+                printf("Invalid leaf in model file: %s", line_buff);
+                return 1;
+            }
+            node = &nodes[(num_trees - 1) * MODEL_MAX_NODES + id];
+            node->used = 1;
+            node->is_leaf = 1;
+            memcpy(node->score, score, sizeof(score));
+        }
+        else if (strspn(line_buff, " \t\r\n") != strlen(line_buff)) {
+            printf("Invalid line in model file: %s", line_buff);
+            return 1;
+        }
+    }
+    fclose(fpin);
+
+    if (num_trees == 0) {
+        printf("No trees in model file: %s\n", argv[0]);
+        return 1;
+    }
+
+    /* All trees are padded to the depth of the deepest tree */
+    for (t = 0; t < num_trees; t++) {
+        d = model_depth(&nodes[t * MODEL_MAX_NODES], 0, 0);
+        if (d < 0) {
+            printf("Tree %u is invalid or deeper than %d levels\n", t, MODEL_MAX_DEPTH);
+            return 1;
+        }
+        if ((unsigned int)d > depth)
+            depth = (unsigned int)d;
+    }
+    for (t = 0; t < num_trees; t++)
+        model_flatten(&nodes[t * MODEL_MAX_NODES], 0, 0, 0, depth, &trees[t]);
+    num_nodes = (1 << depth) - 1;
+
+    fpout = fopen(argv[1], "w");
+    if (fpout == NULL) {
+        printf("Cannot open header file: %s\n", argv[1]);
+        return 1;
+    }
+
+    fprintf(fpout, "/* Generated by pedometer --compile-model from %s, do not edit */\n\n", argv[0]);
+    fprintf(fpout, "#ifndef __MOTION_MODEL_H__\n#define __MOTION_MODEL_H__\n\n");
+    fprintf(fpout, "#define MODEL_NUM_TREES     ( %u )\n", num_trees);
+    fprintf(fpout, "#define MODEL_DEPTH         ( %u )\n", depth);
+    fprintf(fpout, "#define MODEL_NUM_NODES     ( (1 << MODEL_DEPTH) - 1 )\n\n");
+
+    fprintf(fpout, "/* Feature index of each decision node */\n");
+    fprintf(fpout, "static const unsigned char ModelFeature[MODEL_NUM_TREES][MODEL_NUM_NODES] = {\n");
+    for (t = 0; t < num_trees; t++) {
+        fprintf(fpout, "    { ");
+        for (n = 0; n < num_nodes; n++)
+            fprintf(fpout, "%u%s", trees[t].feature[n], (n + 1 < num_nodes) ? ", " : " },\n");
+    }
+    fprintf(fpout, "};\n\n");
+
+    fprintf(fpout, "/* Threshold of each decision node, go right if x[feature] > threshold */\n");
+    fprintf(fpout, "static const float ModelThreshold[MODEL_NUM_TREES][MODEL_NUM_NODES] = {\n");
+    for (t = 0; t < num_trees; t++) {
+        fprintf(fpout, "    { ");
+        for (n = 0; n < num_nodes; n++) {
+            model_print_float(fpout, trees[t].threshold[n]);
+            fprintf(fpout, "%s", (n + 1 < num_nodes) ? ", " : " },\n");
+        }
+    }
+    fprintf(fpout, "};\n\n");
+
+    fprintf(fpout, "/* Class scores (STATIC, WALK, HOP, RUN) of each leaf */\n");
+    fprintf(fpout, "static const float ModelLeaf[MODEL_NUM_TREES][MODEL_NUM_NODES + 1][NUM_TYPES] = {\n");
+    for (t = 0; t < num_trees; t++) {
+        fprintf(fpout, "    {\n");
+        for (n = 0; n <= num_nodes; n++) {
+            fprintf(fpout, "        { ");
+            for (c = 0; c < NUM_TYPES; c++) {
+                model_print_float(fpout, trees[t].leaf[n][c]);
+                fprintf(fpout, "%s", (c + 1 < NUM_TYPES) ? ", " : " },\n");
+            }
+        }
+        fprintf(fpout, "    },\n");
+    }
+    fprintf(fpout, "};\n\n");
+    fprintf(fpout, "#endif /* __MOTION_MODEL_H__ */\n");
+    fclose(fpout);
+
+    printf("Compiled %u trees of depth %u into %s\n", num_trees, depth, argv[1]);
+
+    free(nodes);
+    free(trees);
+
+    return 0;
+
+}
+
+
+/*
+  NUMA placement
+
+  On multi socket servers the worker threads of the batch and load modes are
+  pinned per NUMA node (worker t to node t % nodes, free to run on any CPU of
+  the node) and the state of the sessions a worker serves (algo instances,
+  buffers, a copy of the shared recording) is allocated on the node of the
+  worker, so workers do not touch filter state and buffers on the other
+  socket. The topology is read from sysfs and memory is placed with mbind
+  (no libnuma). --numa off keeps the default placement, e.g. for comparison
+  with --bench numa.
+*/
+
+/* Parse a sysfs CPU list, e.g. 0-3,8-11
+*  Input: CPU list, CPU set (output)
+*  Output: None
+*/
+#if defined(__linux__)
+static void numa_parse_cpulist(const char *list, cpu_set_t *set)
+{
+    unsigned int  lo, hi, c;
+    int           n;
+
+    CPU_ZERO(set);
+    while (sscanf(list, "%u%n", &lo, &n) == 1) {
+        list += n;
+        hi = lo;
+        if ((*list == '-') && (sscanf(list + 1, "%u%n", &hi, &n) == 1))
+            list += 1 + n;
+        for (c = lo; (c <= hi) && (c < CPU_SETSIZE); c++)
+            CPU_SET(c, set);
+        if (*list != ',')
+            break;
+        list++;
+    }
+
+}
+#endif
+
+
+/* Read the NUMA nodes and the CPUs of every node the process may run on.
+*  Nodes without such CPUs (memory only) are left out; without NUMA
+*  information all CPUs are one node.
+*  Input: Topology (output)
+*  Output: None
+*/
+static void numa_init(numa_topo_t *topo)
+{
+    memset(topo, 0, sizeof(*topo));
+#if defined(__linux__)
+    {
+        DIR           *dir;
+        struct dirent *ent;
+        FILE          *fp;
+        char          path[300], list[1024];
+        cpu_set_t     allowed, node_cpus;
+        int           id;
+        unsigned int  n;
+
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+            CPU_ZERO(&allowed);
+            CPU_SET(0, &allowed);
+        }
+        dir = opendir("/sys/devices/system/node");
+        while ((dir != NULL) && ((ent = readdir(dir)) != NULL) && (topo->num_nodes < NUMA_MAX_NODES)) {
+            if ((sscanf(ent->d_name, "node%d", &id) != 1) || (id < 0) || (id >= NUMA_MAX_NODES))
+                continue;
+            snprintf(path, sizeof(path), "/sys/devices/system/node/%s/cpulist", ent->d_name);
+            fp = fopen(path, "r");
+            if (fp == NULL)
+                continue;
+            if (fgets(list, sizeof(list), fp) != NULL) {
+                numa_parse_cpulist(list, &node_cpus);
+                CPU_AND(&node_cpus, &node_cpus, &allowed);
+                if (CPU_COUNT(&node_cpus) > 0) {
+                    n = topo->num_nodes++;
+                    topo->node_id[n] = id;
+                    topo->cpus[n] = node_cpus;
+                    topo->num_cpus[n] = (unsigned int)CPU_COUNT(&node_cpus);
+                }
+            }
+            fclose(fp);
+        }
+        if (dir != NULL)
+            closedir(dir);
+        if (topo->num_nodes == 0) {
+            topo->num_nodes = 1;
+            topo->node_id[0] = -1;
+            topo->cpus[0] = allowed;
+            topo->num_cpus[0] = (unsigned int)CPU_COUNT(&allowed);
+        }
+    }
+#else
+    topo->num_nodes = 1;
+    topo->node_id[0] = -1;
+    topo->num_cpus[0] = 1;
+#endif
+
+}
+
+
+/* NUMA node of a worker thread, the workers are spread over the nodes
+*  Input: Worker thread number
+*  Output: Node (index into NumaTopo), -1 without NUMA placement
+*/
+static int numa_worker_node(unsigned int t)
+{
+    if ((NumaPlace == 0) || (NumaTopo.num_nodes == 0))
+        return -1;
+
+    return (int)(t % NumaTopo.num_nodes);
+
+}
+
+
+/* Pin the calling thread to the CPUs of a node
+*  Input: Node, -1 for no pinning
+*  Output: None
+*/
+static void numa_pin(int node)
+{
+#if defined(__linux__)
+    if (node >= 0)
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &NumaTopo.cpus[node]);
+#endif
+
+}
+
+
+/* Allocate zeroed memory on a node, preferred by the kernel when the pages
+*  are first touched (falls back to other nodes if the node is full)
+*  Input: Size in bytes, node, -1 for the default placement
+*  Output: Memory (free with numa_free), NULL if out of memory
+*/
+static void *numa_alloc(size_t size, int node)
+{
+#if defined(__linux__)
+    void          *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    unsigned long mask;
+
+    if (ptr == MAP_FAILED)
+        return NULL;
+    if ((node >= 0) && (NumaTopo.node_id[node] >= 0)) {
+        mask = 1UL << NumaTopo.node_id[node];
+        syscall(__NR_mbind, ptr, size, MPOL_PREFERRED, &mask, sizeof(mask) * 8 + 1, 0);
+    }
+
+    return ptr;
+#else
+    (void)node;
+    return calloc(1, size);
+#endif
+
+}
+
+
+/* Free memory of numa_alloc
+*  Input: Memory, size in bytes
+*  Output: None
+*/
+static void numa_free(void *ptr, size_t size)
+{
+#if defined(__linux__)
+    if (ptr != NULL)
+        munmap(ptr, size);
+#else
+    (void)size;
+    free(ptr);
+#endif
+
+}
+
+
+/*
+  Benchmarks
+
+  Micro benchmarks of the algorithm stages, run with --bench [name].
+*/
+
+#define BENCH_NUM_INPUTS      ( 4096 )
+#define BENCH_FIFO_WATERMARK  ( 32 )   /* samples per FIFO interrupt */
+#define BENCH_NUM_COUNTERS    ( 4 )    /* cycles, instructions, branch misses, cache misses */
+#define BENCH_PERF_MIN_SAMPLES ( 1 << 20 )
+#define BENCH_NUMA_MAX_THREADS ( 64 )
+#define BENCH_SESSION_DROP    ( 50 )   /* records dropped in the session check, inside the TIME tolerance */
+
+/* Time and hardware counters of one pipeline stage */
+typedef struct {
+    double              sec;
+    unsigned long long  cnt[BENCH_NUM_COUNTERS];
+    int                 valid;
+} bench_stage_t;
+
+/* Monotonic time in sec */
+static double get_time_sec(void)
+{
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+
+/* Random number in [lo, hi) */
+static float bench_rand(float lo, float hi)
+{
+    return lo + (hi - lo) * ((float)rand() / ((float)RAND_MAX + 1.0f));
+}
+
+
+/* Benchmark motion classification per block, threshold chain vs compiled model
+*  Input: None
+*  Output: None
+*/
+static void bench_classify(void)
+{
+    block_feat_t          *feats;
+    unsigned int          i, ax, k, iter, num_iter = 200;
+    volatile unsigned int sink = 0;
+    unsigned int          acc;
+    double                t_start, t_chain, t_model;
+
+    feats = calloc(BENCH_NUM_INPUTS, sizeof(block_feat_t));
+    if (feats == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    srand(1);
+    for (i = 0; i < BENCH_NUM_INPUTS; i++) {
+        feats[i].amp_est = bench_rand(0.0f, 25.0f);
+        feats[i].freq_est = bench_rand(0.0f, 4.0f);
+        for (ax = 0; ax < NUM_SENS_AXES; ax++) {
+            feats[i].axis[ax].mean = bench_rand(-1.0f, 1.0f);
+            feats[i].axis[ax].var = bench_rand(0.0f, 20.0f);
+            feats[i].axis[ax].energy = bench_rand(0.0f, 20.0f);
+            feats[i].axis[ax].min = bench_rand(-10.0f, 0.0f);
+            feats[i].axis[ax].max = bench_rand(0.0f, 10.0f);
+            feats[i].axis[ax].zcr = bench_rand(0.0f, 0.5f);
+            for (k = 0; k < NUM_SPEC_BINS; k++)
+                feats[i].axis[ax].spec[k] = bench_rand(0.0f, 5.0f);
+        }
+    }
+
+    acc = 0;
+    t_start = get_time_sec();
+    for (iter = 0; iter < num_iter; iter++) {
+        for (i = 0; i < BENCH_NUM_INPUTS; i++)
+            acc += classify_motion(&algo_cfg_default, feats[i].amp_est, feats[i].freq_est);
+    }
+    t_chain = get_time_sec() - t_start;
+    sink += acc;
+
+    acc = 0;
+    t_start = get_time_sec();
+    for (iter = 0; iter < num_iter; iter++) {
+        for (i = 0; i < BENCH_NUM_INPUTS; i++)
+            acc += classify_motion_model(&feats[i]);
+    }
+    t_model = get_time_sec() - t_start;
+    sink += acc;
+
+    printf("classify: threshold chain %.1f ns/block, compiled model (%d trees, depth %d) %.1f ns/block\n",
+        t_chain * 1E9 / (num_iter * BENCH_NUM_INPUTS), MODEL_NUM_TREES, MODEL_DEPTH,
+        t_model * 1E9 / (num_iter * BENCH_NUM_INPUTS));
+
+    free(feats);
+
+}
+
+
+/* Benchmark the filter engine on a synthetic multi-hour stationary input:
+*  a few seconds of motion followed by exact zeros, where the filter state
+*  decays into the subnormal range unless it is flushed. The cost per sample
+*  is reported per time slice, for apply_filter and for the same recurrence
+*  without flushing.
+*  Input: None
+*  Output: None
+*/
+static void bench_denormal(void)
+{
+#define BENCH_DENORMAL_HOURS      ( 3 )
+#define BENCH_DENORMAL_SLICE_SEC  ( 1800 )
+
+    unsigned int  num_samp = BENCH_DENORMAL_HOURS * 3600 * SENSOR_SAMP_FREQ;
+    unsigned int  slice_len = BENCH_DENORMAL_SLICE_SEC * SENSOR_SAMP_FREQ;
+    unsigned int  i, s;
+    float         *in_data;
+    filter_t      lp_filter, ll_filter, lp_raw, ll_raw;
+    float         out_data;
+    volatile float sink = 0.0f;
+    double        t_start, t_flush, t_raw;
+
+    in_data = malloc(num_samp * sizeof(float));
+    if (in_data == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < num_samp; i++)
+        in_data[i] = (i < 5 * SENSOR_SAMP_FREQ) ? 10.0f * sinf(2.0f * (float)M_PI * 2.0f * i / SENSOR_SAMP_FREQ) : 0.0f;
+
+    init_lp_filter(&lp_filter);
+    init_ll_filter(&ll_filter);
+    lp_raw = lp_filter;
+    ll_raw = ll_filter;
+
+    printf("denormal: ns/sample of lp + lead-lag filter per %d min of stationary input\n", BENCH_DENORMAL_SLICE_SEC / 60);
+    printf("  %8s %10s %12s\n", "minutes", "flushed", "not flushed");
+    for (s = 0; s + slice_len <= num_samp; s += slice_len) {
+        t_start = get_time_sec();
+        for (i = s; i < s + slice_len; i++)
+            sink += apply_filter(&ll_filter, apply_filter(&lp_filter, in_data[i]));
+        t_flush = get_time_sec() - t_start;
+
+        /* same recurrence without flushing the state */
+        t_start = get_time_sec();
+        for (i = s; i < s + slice_len; i++) {
+            filter_t  *f = &lp_raw;
+            float     x = in_data[i];
+            unsigned int k;
+
+            for (k = 0; k < 2; k++) {
+                out_data = (f->b0 * x) + (f->b1 * f->prev_in) + (f->b2 * f->prev_prev_in)
+                    - (f->a1 * f->prev_out) - (f->a2 * f->prev_prev_out);
+                f->prev_prev_in = f->prev_in;
+                f->prev_in = x;
+                f->prev_prev_out = f->prev_out;
+                f->prev_out = out_data;
+                x = out_data;
+                f = &ll_raw;
+            }
+            sink += x;
+        }
+        t_raw = get_time_sec() - t_start;
+
+        printf("  %8u %10.2f %12.2f\n", (s + slice_len) / (60 * SENSOR_SAMP_FREQ),
+            t_flush * 1E9 / slice_len, t_raw * 1E9 / slice_len);
+    }
+
+    free(in_data);
+
+}
+
+
+/* Synthetic walking signal, interleaved AccX, AccY, AccZ, GyroX, GyroY, GyroZ
+*  samples with a 1.8 Hz AccY oscillation and noise on all axes
+*  Input: Output array (num_samp * NUM_SENS_AXES), number of samples
+*  Output: None
+*/
+static void bench_walk_signal(float *fifo, unsigned int num_samp)
+{
+    unsigned int  i, ax;
+    float         *s;
+
+    srand(1);
+    for (i = 0; i < num_samp; i++) {
+        s = fifo + i * NUM_SENS_AXES;
+        s[CHX] = bench_rand(-0.5f, 0.5f);
+        s[CHY] = 9.81f + 6.0f * (float)sin(2.0 * M_PI * 1.8 * i / SENSOR_SAMP_FREQ) + bench_rand(-0.5f, 0.5f);
+        s[CHZ] = bench_rand(-0.5f, 0.5f);
+        for (ax = NUM_DIM; ax < NUM_SENS_AXES; ax++)
+            s[ax] = bench_rand(-1.0f, 1.0f);
+    }
+
+}
+
+
+/* Benchmark the sensor input path: one step_algo_preproc call per sample
+*  against step_algo_push with FIFO bursts of BENCH_FIFO_WATERMARK samples,
+*  float and int16, and step_algo_push_arrays with one array per axis, on a
+*  synthetic walking signal. The algorithm runs are included in all four.
+*  Input: None
+*  Output: None
+*/
+static void bench_push(void)
+{
+    static step_algo_t    algo;
+    const unsigned int    num_samp = 64 * 1024;
+    const fifo_desc_t     desc_flt = { FIFO_FLOAT, NUM_SENS_AXES, 1.0f, 1.0f };
+    const fifo_desc_t     desc_i16 = { FIFO_INT16, NUM_SENS_AXES, 1.0f / 1024, 1.0f / 1024 };
+    float                 *fifo_flt;
+    short                 *fifo_i16;
+    float                 *arrays;
+    const float           *axes[NUM_SENS_AXES];
+    unsigned int          i, ax, steps[4];
+    float                 timestamp, *s;
+    double                t_start, t_samp, t_flt, t_i16, t_arr;
+
+    fifo_flt = malloc(num_samp * NUM_SENS_AXES * sizeof(float));
+    fifo_i16 = malloc(num_samp * NUM_SENS_AXES * sizeof(short));
+    arrays = malloc(num_samp * NUM_SENS_AXES * sizeof(float));
+    if ((fifo_flt == NULL) || (fifo_i16 == NULL) || (arrays == NULL)) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    bench_walk_signal(fifo_flt, num_samp);
+    for (i = 0; i < num_samp * NUM_SENS_AXES; i++)
+        fifo_i16[i] = (short)lrintf(fifo_flt[i] * 1024);
+    for (ax = 0; ax < NUM_SENS_AXES; ax++) {
+        for (i = 0; i < num_samp; i++)
+            arrays[ax * num_samp + i] = fifo_flt[i * NUM_SENS_AXES + ax];
+        axes[ax] = arrays + ax * num_samp;
+    }
+
+    init_algo_out(&algo.out);
+    step_algo_reset(&algo);
+    timestamp = 0.0f;
+    t_start = get_time_sec();
+    for (i = 0; i < num_samp; i++) {
+        s = fifo_flt + i * NUM_SENS_AXES;
+        timestamp += SENSOR_SAMP_INTVL;
+        if (step_algo_preproc(&algo, timestamp, s[0], s[1], s[2], s[3], s[4], s[5]) == 1)
+            step_algo_run(&algo);
+    }
+    t_samp = get_time_sec() - t_start;
+    steps[0] = algo.out.step_count;
+
+    init_algo_out(&algo.out);
+    step_algo_reset(&algo);
+    t_start = get_time_sec();
+    for (i = 0; i < num_samp; i += BENCH_FIFO_WATERMARK)
+        step_algo_push(&algo, &desc_flt, fifo_flt + i * NUM_SENS_AXES, BENCH_FIFO_WATERMARK, (i + 1) * SENSOR_SAMP_INTVL);
+    t_flt = get_time_sec() - t_start;
+    steps[1] = algo.out.step_count;
+
+    init_algo_out(&algo.out);
+    step_algo_reset(&algo);
+    t_start = get_time_sec();
+    for (i = 0; i < num_samp; i += BENCH_FIFO_WATERMARK)
+        step_algo_push(&algo, &desc_i16, fifo_i16 + i * NUM_SENS_AXES, BENCH_FIFO_WATERMARK, (i + 1) * SENSOR_SAMP_INTVL);
+    t_i16 = get_time_sec() - t_start;
+    steps[2] = algo.out.step_count;
+
+    init_algo_out(&algo.out);
+    step_algo_reset(&algo);
+    t_start = get_time_sec();
+    step_algo_push_arrays(&algo, axes, NULL, num_samp, SENSOR_SAMP_INTVL);
+    t_arr = get_time_sec() - t_start;
+    steps[3] = algo.out.step_count;
+
+    printf("push: per sample %.1f ns/sample, FIFO burst of %d float %.1f ns/sample, int16 %.1f ns/sample, "
+        "per axis arrays %.1f ns/sample (steps %u/%u/%u/%u)\n",
+        t_samp * 1E9 / num_samp, BENCH_FIFO_WATERMARK, t_flt * 1E9 / num_samp, t_i16 * 1E9 / num_samp,
+        t_arr * 1E9 / num_samp, steps[0], steps[1], steps[2], steps[3]);
+
+    free(fifo_flt);
+    free(fifo_i16);
+    free(arrays);
+
+}
+
+
+/* Shared state of the handoff stress test threads */
+typedef struct {
+    sample_ring_t         ring;
+    step_algo_t           algo;
+    const float           *fifo;
+    unsigned int          num_samp;
+    unsigned int          seed;
+    unsigned long         producer_waits;
+} bench_handoff_t;
+
+
+/* Producer thread of the handoff stress test, plays the sensor interrupt:
+*  puts samples in random sized bursts, retries while the ring is full
+*  Input: Pointer to bench_handoff_t
+*  Output: NULL
+*/
+static void *bench_handoff_producer(void *arg)
+{
+    bench_handoff_t       *h = (bench_handoff_t *)arg;
+    const float           *s;
+    unsigned int          i = 0, burst;
+    volatile unsigned int delay;
+
+    while (i < h->num_samp) {
+        burst = 1 + rand_r(&h->seed) % BENCH_FIFO_WATERMARK;
+        for (; (burst > 0) && (i < h->num_samp); burst--, i++) {
+            s = h->fifo + i * NUM_SENS_AXES;
+            while (sample_ring_put(&h->ring, s[0], s[1], s[2], s[3], s[4], s[5]) != 0) {
+                h->producer_waits++;
+                sched_yield();
+            }
+        }
+        for (delay = rand_r(&h->seed) % 256; delay > 0; delay--)
+            ;
+    }
+
+    return NULL;
+
+}
+
+
+/* Consumer thread of the handoff stress test, plays the main loop
+*  Input: Pointer to bench_handoff_t
+*  Output: NULL
+*/
+static void *bench_handoff_consumer(void *arg)
+{
+    bench_handoff_t       *h = (bench_handoff_t *)arg;
+    unsigned int          consumed = 0, num_samp;
+    float                 timestamp = 0.0f;
+
+    while (consumed < h->num_samp) {
+        num_samp = sample_ring_drain(&h->ring, &h->algo, &timestamp);
+        if (num_samp == 0)
+            sched_yield();
+        consumed += num_samp;
+    }
+
+    return NULL;
+
+}
+
+
+/* Stress test of the ISR to main loop sample ring: a producer and a consumer
+*  thread run concurrently for several rounds and the algo output has to be
+*  identical to processing the same samples in a single thread. Samples put
+*  into a full ring are retried, so no sample is lost (the ring overruns are
+*  reported as producer waits).
+*  Input: None
+*  Output: None
+*/
+static void bench_handoff(void)
+{
+    static bench_handoff_t  h;
+    static step_algo_t      ref;
+    const fifo_desc_t       desc = { FIFO_FLOAT, NUM_SENS_AXES, 1.0f, 1.0f };
+    const unsigned int      num_samp = 64 * 1024, num_rounds = 20;
+    pthread_t               producer, consumer;
+    float                   *fifo;
+    unsigned int            r, failed = 0;
+    unsigned long           waits = 0;
+    double                  t_start, t_total = 0.0;
+
+    fifo = malloc(num_samp * NUM_SENS_AXES * sizeof(float));
+    if (fifo == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    bench_walk_signal(fifo, num_samp);
+
+    init_algo_out(&ref.out);
+    step_algo_reset(&ref);
+    step_algo_push(&ref, &desc, fifo, num_samp, SENSOR_SAMP_INTVL);
+
+    for (r = 0; r < num_rounds; r++) {
+        sample_ring_init(&h.ring);
+        init_algo_out(&h.algo.out);
+        step_algo_reset(&h.algo);
+        h.fifo = fifo;
+        h.num_samp = num_samp;
+        h.seed = r + 1;
+        h.producer_waits = 0;
+
+        t_start = get_time_sec();
+        if ((pthread_create(&consumer, NULL, bench_handoff_consumer, &h) != 0) ||
+            (pthread_create(&producer, NULL, bench_handoff_producer, &h) != 0)) {
+            printf("Cannot create threads\n");
+            exit(1);
+        }
+        pthread_join(producer, NULL);
+        pthread_join(consumer, NULL);
+        t_total += get_time_sec() - t_start;
+
+        waits += h.producer_waits;
+        if (memcmp(&h.algo.out, &ref.out, sizeof(ref.out)) != 0)
+            failed++;
+    }
+
+    printf("handoff: %u rounds of %u samples, %.1f ns/sample, %lu producer waits (ring full), %u steps, %s\n",
+        num_rounds, num_samp, t_total * 1E9 / (num_rounds * num_samp), waits, ref.out.step_count,
+        (failed == 0) ? "all rounds identical to single thread" : "MISMATCH");
+    if (failed > 0)
+        exit(1);
+
+    free(fifo);
+
+}
+
+
+/* Open a group of hardware counters (cycles, instructions, branch misses,
+*  cache misses) for the calling thread, user space only
+*  Input: Array of BENCH_NUM_COUNTERS file descriptors to fill
+*  Output: 0 on success, -1 if the counters are not available
+*/
+static int perf_open_counters(int *fd)
+{
+#if defined(__linux__)
+    static const unsigned long long config[BENCH_NUM_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES
+    };
+    struct perf_event_attr  attr;
+    unsigned int            c;
+
+    for (c = 0; c < BENCH_NUM_COUNTERS; c++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config[c];
+        attr.disabled = (c == 0) ? 1 : 0;   /* the group leader starts all */
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        fd[c] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, (c == 0) ? -1 : fd[0], 0);
+        if (fd[c] < 0) {
+            while (c > 0)
+                close(fd[--c]);
+            return -1;
+        }
+    }
+
+    return 0;
+#else
+    (void)fd;
+    return -1;
+#endif
+
+}
+
+
+/* Start the counters and the timer of one pipeline stage
+*  Input: Counter file descriptors (NULL if not available), pointer to the stage result
+*  Output: None
+*/
+static void bench_stage_begin(const int *fd, bench_stage_t *st)
+{
+#if defined(__linux__)
+    if (fd != NULL) {
+        ioctl(fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+    st->sec = get_time_sec();
+
+}
+
+
+/* Stop the counters and the timer of one pipeline stage
+*  Input: Counter file descriptors (NULL if not available), pointer to the stage result
+*  Output: None
+*/
+static void bench_stage_end(const int *fd, bench_stage_t *st)
+{
+    unsigned long long  buf[1 + BENCH_NUM_COUNTERS];
+    unsigned int        c;
+
+    st->sec = get_time_sec() - st->sec;
+    st->valid = 0;
+#if defined(__linux__)
+    if (fd != NULL) {
+        ioctl(fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        if ((read(fd[0], buf, sizeof(buf)) == sizeof(buf)) && (buf[0] == BENCH_NUM_COUNTERS)) {
+            for (c = 0; c < BENCH_NUM_COUNTERS; c++)
+                st->cnt[c] = buf[1 + c];
+            st->valid = 1;
+        }
+    }
+#else
+    (void)buf;
+    (void)c;
+#endif
+
+}
+
+
+/* Print the result of one pipeline stage per sample
+*  Input: Input name, number of samples processed, stage name, pointer to the stage result
+*  Output: None
+*/
+static void bench_stage_print(const char *input, double num_samp, const char *stage, const bench_stage_t *st)
+{
+    if (st->valid == 1)
+        printf("  %-40s %-7s %8.2f %6.2f %10.4f %10.4f\n", input, stage, st->sec * 1E9 / num_samp,
+            (st->cnt[0] > 0) ? (double)st->cnt[1] / st->cnt[0] : 0.0,
+            st->cnt[2] / num_samp, st->cnt[3] / num_samp);
+    else
+        printf("  %-40s %-7s %8.2f %6s %10s %10s\n", input, stage, st->sec * 1E9 / num_samp, "-", "-", "-");
+
+}
+
+
+/* Run the pipeline stages on AccY data one stage at a time over the whole
+*  input (like sweep mode) and report each stage: low pass filter, lead-lag
+*  derivative, zero crossing search and step detection. Short inputs are
+*  repeated to about BENCH_PERF_MIN_SAMPLES samples.
+*  Input: Input name, AccY data, number of samples, counter file descriptors
+*         (NULL if not available)
+*  Output: None
+*/
+static void bench_perf_input(const char *input, const float *ary, unsigned int num_samp, const int *fd)
+{
+    filter_t            lp_filter, ll_filter;
+    algo_out_t          algo_out;
+    bench_stage_t       st;
+    unsigned int        TC_samples, num_blocks, num_rep, rep, b, i;
+    unsigned int        *zc_idx, *zc_off;
+    float               *filt, *ts, *der;
+
+    init_lp_filter(&lp_filter);
+    init_ll_filter(&ll_filter);
+    init_algo_out(&algo_out);
+    TC_samples = ll_filter.TC_samples;
+    num_blocks = num_samp / SAMP_BUFF_LEN;
+    num_samp = num_blocks * SAMP_BUFF_LEN;
+    if (num_samp == 0)
+        return;
+    num_rep = (BENCH_PERF_MIN_SAMPLES + num_samp - 1) / num_samp;
+
+    filt = calloc(TC_samples + num_samp, sizeof(float));
+    ts = calloc(TC_samples + num_samp, sizeof(float));
+    der = malloc(num_samp * sizeof(float));
+    zc_idx = malloc(num_samp * sizeof(unsigned int));
+    zc_off = malloc((num_blocks + 1) * sizeof(unsigned int));
+    if ((filt == NULL) || (ts == NULL) || (der == NULL) || (zc_idx == NULL) || (zc_off == NULL)) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < num_samp; i++)
+        ts[TC_samples + i] = (i + 1) * SENSOR_SAMP_INTVL;
+
+    bench_stage_begin(fd, &st);
+    for (rep = 0; rep < num_rep; rep++) {
+        for (i = 0; i < num_samp; i++)
+            filt[TC_samples + i] = apply_filter(&lp_filter, ary[i]);
+    }
+    bench_stage_end(fd, &st);
+    bench_stage_print(input, (double)num_rep * num_samp, "lp", &st);
+
+    bench_stage_begin(fd, &st);
+    for (rep = 0; rep < num_rep; rep++) {
+        for (i = 0; i < num_samp; i++)
+            der[i] = apply_filter(&ll_filter, filt[TC_samples + i]);
+    }
+    bench_stage_end(fd, &st);
+    bench_stage_print(input, (double)num_rep * num_samp, "ll", &st);
+
+    bench_stage_begin(fd, &st);
+    for (rep = 0; rep < num_rep; rep++) {
+        zc_off[0] = 0;
+        for (b = 0; b < num_blocks; b++)
+            zc_off[b + 1] = zc_off[b] + step_algo_find_zc(der + b * SAMP_BUFF_LEN,
+                (b > 0) ? der[b * SAMP_BUFF_LEN - 1] : 0.0f, SAMP_BUFF_LEN, zc_idx + zc_off[b]);
+    }
+    bench_stage_end(fd, &st);
+    bench_stage_print(input, (double)num_rep * num_samp, "zc", &st);
+
+    bench_stage_begin(fd, &st);
+    for (rep = 0; rep < num_rep; rep++) {
+        init_algo_out(&algo_out);
+        for (b = 0; b < num_blocks; b++)
+            step_algo_detect(&algo_cfg_default, &algo_out, der + b * SAMP_BUFF_LEN, filt + b * SAMP_BUFF_LEN,
+                ts + b * SAMP_BUFF_LEN, 0.0f, NULL, zc_idx + zc_off[b], zc_off[b + 1] - zc_off[b], NULL);
+    }
+    bench_stage_end(fd, &st);
+    bench_stage_print(input, (double)num_rep * num_samp, "detect", &st);
+
+    free(filt);
+    free(ts);
+    free(der);
+    free(zc_idx);
+    free(zc_off);
+
+}
+
+
+/* Benchmark the pipeline stages with hardware performance counters (Linux
+*  perf_event_open, see perf_event_paranoid) on the bundled recordings in the
+*  working directory and on synthetic walking inputs of increasing length.
+*  Reports per stage ns/sample, IPC, branch misses and cache misses per sample;
+*  counters are shown as - if not available.
+*  Input: None
+*  Output: None
+*/
+static void bench_perf(void)
+{
+    static const char   *files[] = {
+        "SensData_run_walk_stripped.csv",
+        "SensData_walk_run_stripped.csv",
+        "SensData_walk_hop_walk_run_stripped.csv",
+    };
+    static const unsigned int synth_len[] = { 1 << 12, 1 << 16, 1 << 20, 1 << 23 };
+    int                 fd_buf[BENCH_NUM_COUNTERS], *fd = fd_buf;
+    FILE                *fpin;
+    sens_data_t         sens_data;
+    float               *ary, *fifo;
+    unsigned int        f, i, num_samp, max_samp;
+    char                name[64];
+
+    if (perf_open_counters(fd_buf) != 0) {
+        printf("perf: hardware counters not available (%s), timing only\n", strerror(errno));
+        fd = NULL;
+    }
+    printf("perf: %-40s %-7s %8s %6s %10s %10s\n", "input", "stage", "ns/samp", "IPC", "br-miss/s", "$-miss/s");
+
+    for (f = 0; f < sizeof(files) / sizeof(files[0]); f++) {
+        fpin = fopen(files[f], "r");
+        if ((fpin == NULL) || (skip_header(fpin) != 0)) {
+            printf("  %-40s skipped, cannot read\n", files[f]);
+            if (fpin != NULL)
+                fclose(fpin);
+            continue;
+        }
+        num_samp = 0;
+        max_samp = 1024;
+        ary = malloc(max_samp * sizeof(float));
+        while ((ary != NULL) && (read_sens_data(fpin, &sens_data) == 0)) {
+            if (num_samp == max_samp) {
+                max_samp = 2 * max_samp;
+                ary = realloc(ary, max_samp * sizeof(float));
+                if (ary == NULL)
+                    break;
+            }
+            ary[num_samp++] = sens_data.ary;
+        }
+        fclose(fpin);
+        if (ary == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+        bench_perf_input(files[f], ary, num_samp, fd);
+        free(ary);
+    }
+
+    for (f = 0; f < sizeof(synth_len) / sizeof(synth_len[0]); f++) {
+        num_samp = synth_len[f];
+        fifo = malloc(num_samp * NUM_SENS_AXES * sizeof(float));
+        ary = malloc(num_samp * sizeof(float));
+        if ((fifo == NULL) || (ary == NULL)) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+        bench_walk_signal(fifo, num_samp);
+        for (i = 0; i < num_samp; i++)
+            ary[i] = fifo[i * NUM_SENS_AXES + CHY];
+        snprintf(name, sizeof(name), "synthetic %u samples", num_samp);
+        bench_perf_input(name, ary, num_samp, fd);
+        free(fifo);
+        free(ary);
+    }
+
+    if (fd != NULL) {
+        for (i = 0; i < BENCH_NUM_COUNTERS; i++)
+            close(fd[i]);
+    }
+
+}
+
+
+/* Benchmark the SIMD kernel variants the build and CPU support against each
+*  other, zero crossings and magnitude per block of SAMP_BUFF_LEN samples,
+*  and check that they find the same zero crossings as the scalar reference
+*  Input: None
+*  Output: None
+*/
+static void bench_simd(void)
+{
+    const simd_kernels_t  *selected = SimdKernels;
+    const unsigned int    num_blocks = BENCH_NUM_INPUTS, num_iter = 50;
+    float                 *der, *x, *y, *z, *mag;
+    unsigned int          zc_idx[SAMP_BUFF_LEN];
+    unsigned int          v, b, iter, num_zc, ref_zc = 0;
+    double                t_start, t_zc, t_mag;
+
+    der = malloc(4 * num_blocks * SAMP_BUFF_LEN * sizeof(float));
+    mag = malloc(num_blocks * SAMP_BUFF_LEN * sizeof(float));
+    if ((der == NULL) || (mag == NULL)) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    x = der + num_blocks * SAMP_BUFF_LEN;
+    y = x + num_blocks * SAMP_BUFF_LEN;
+    z = y + num_blocks * SAMP_BUFF_LEN;
+    srand(1);
+    for (b = 0; b < num_blocks * SAMP_BUFF_LEN; b++) {
+        der[b] = (float)sin(2.0 * M_PI * 1.8 * b / SENSOR_SAMP_FREQ) + bench_rand(-0.3f, 0.3f);
+        x[b] = bench_rand(-2.0f, 2.0f);
+        y[b] = 9.81f + bench_rand(-6.0f, 6.0f);
+        z[b] = bench_rand(-2.0f, 2.0f);
+    }
+
+    for (v = 0; v < NUM_SIMD_VARIANTS; v++) {
+        if (simd_select(SimdVariants[v].name) != 0)
+            continue;
+        num_zc = 0;
+        t_start = get_time_sec();
+        for (iter = 0; iter < num_iter; iter++) {
+            for (b = 0; b < num_blocks; b++)
+                num_zc += SimdKernels->find_zc(der + b * SAMP_BUFF_LEN, (b > 0) ? der[b * SAMP_BUFF_LEN - 1] : 0.0f,
+                                               SAMP_BUFF_LEN, zc_idx);
+        }
+        t_zc = get_time_sec() - t_start;
+        t_start = get_time_sec();
+        for (iter = 0; iter < num_iter; iter++) {
+            for (b = 0; b < num_blocks; b++)
+                SimdKernels->acc_magnitude(x + b * SAMP_BUFF_LEN, y + b * SAMP_BUFF_LEN, z + b * SAMP_BUFF_LEN,
+                                           mag + b * SAMP_BUFF_LEN, SAMP_BUFF_LEN);
+        }
+        t_mag = get_time_sec() - t_start;
+        if (v == 0)
+            ref_zc = num_zc;
+
+        printf("simd: %-6s zero crossings %.2f ns/sample, magnitude %.2f ns/sample, %s%s\n", SimdVariants[v].name,
+            t_zc * 1E9 / (num_iter * num_blocks * SAMP_BUFF_LEN), t_mag * 1E9 / (num_iter * num_blocks * SAMP_BUFF_LEN),
+            (num_zc == ref_zc) ? "same zero crossings as scalar" : "MISMATCH",
+            (&SimdVariants[v] == selected) ? " (selected)" : "");
+        if (num_zc != ref_zc)
+            exit(1);
+    }
+    SimdKernels = selected;
+
+    free(der);
+    free(mag);
+
+}
+
+
+/* Check the session mode on the bundled recordings in the working directory,
+*  consecutive parts of one stream (RECORD ids in order) with pauses between
+*  the files and a dropped sample in run_walk: every file has to be one
+*  continuous segment with the steps of processing it on its own. A copy of
+*  walk_run with BENCH_SESSION_DROP records dropped in its middle (more than
+*  SESSION_MAX_FILL, within the TIME tolerance) has to be two segments.
+*  Input: None
+*  Output: None
+*/
+static void bench_session(void)
+{
+    static char           *files[] = {
+        "SensData_walk_run_stripped.csv",
+        "SensData_run_walk_stripped.csv",
+        "SensData_walk_hop_walk_run_stripped.csv",
+    };
+    static step_algo_t    algo;
+    const int             num_files = sizeof(files) / sizeof(files[0]);
+    unsigned int          num_segments, num_filled, file_segments = 0, file_steps = 0;
+    unsigned int          drop_segments = 0, drop_filled = 0, num_rows = 0, drop_start;
+    float                 duration;
+    int                   f, failed, fd;
+    char                  drop_name[] = "/tmp/pedometer_sessionXXXXXX";
+    char                  *drop_files[1] = { drop_name };
+    char                  line_buff[256];
+    FILE                  *fpin, *fpdrop;
+
+    for (f = 0; f < num_files; f++) {
+        if (session_process(NULL, files + f, 1, &algo, &duration, &num_segments, &num_filled) != 0) {
+            printf("session: skipped, the bundled recordings are not in the working directory\n");
+            return;
+        }
+        file_segments += num_segments;
+        file_steps += algo.out.step_count;
+    }
+
+    /* Copy walk_run without the records drop_start .. drop_start + BENCH_SESSION_DROP - 1 */
+    fpin = fopen(files[0], "r");
+    fd = mkstemp(drop_name);
+    fpdrop = (fd >= 0) ? fdopen(fd, "w") : NULL;
+    if ((fpin == NULL) || (fpdrop == NULL)) {
+        printf("session: cannot create the dropped record copy in /tmp\n");
+        exit(1);
+    }
+    while (NULL != fgets(line_buff, sizeof(line_buff), fpin))
+        num_rows++;
+    rewind(fpin);
+    drop_start = num_rows / 2;
+    for (num_rows = 0; NULL != fgets(line_buff, sizeof(line_buff), fpin); num_rows++) {
+        if ((num_rows < drop_start + 2) || (num_rows >= drop_start + 2 + BENCH_SESSION_DROP))
+            fputs(line_buff, fpdrop);
+    }
+    fclose(fpin);
+    fclose(fpdrop);
+    if (session_process(NULL, drop_files, 1, &algo, &duration, &drop_segments, &drop_filled) != 0)
+        drop_segments = 0;
+    unlink(drop_name);
+
+    session_process(NULL, files, num_files, &algo, &duration, &num_segments, &num_filled);
+    failed = (file_segments != (unsigned int)num_files) || (num_segments != (unsigned int)num_files) ||
+             (algo.out.step_count != file_steps) || (drop_segments != 2) || (drop_filled != 0);
+
+    printf("session: %d files as %u segments (%u file by file), %u missing records filled, %u steps "
+        "(%u file by file), %u dropped records as %u segments (%u filled), %s\n", num_files, num_segments,
+        file_segments, num_filled, algo.out.step_count, file_steps, BENCH_SESSION_DROP, drop_segments,
+        drop_filled, (failed == 0) ? "segments as expected" : "MISMATCH");
+    if (failed != 0)
+        exit(1);
+
+}
+
+
+/* Work of one thread of the NUMA placement benchmark */
+typedef struct {
+    step_algo_t           *algos;
+    unsigned int          num_algos;
+    const float           *samples;
+    unsigned int          num_samp;
+    int                   node;             /* NUMA node, -1 for the default placement */
+    double                t_run;
+} bench_numa_t;
+
+
+/* Thread of the NUMA placement benchmark, streams the samples through all
+*  its algo instances in FIFO bursts, round robin like the load generator
+*  Input: Pointer to bench_numa_t
+*  Output: NULL
+*/
+static void *bench_numa_worker(void *arg)
+{
+    static const fifo_desc_t  desc = { FIFO_FLOAT, NUM_SENS_AXES, 1.0f, 1.0f };
+    bench_numa_t          *w = (bench_numa_t *)arg;
+    unsigned int          pos, a;
+    double                t_start;
+
+    numa_pin(w->node);
+    t_start = get_time_sec();
+    for (pos = 0; pos + BENCH_FIFO_WATERMARK <= w->num_samp; pos += BENCH_FIFO_WATERMARK) {
+        for (a = 0; a < w->num_algos; a++)
+            step_algo_push(&w->algos[a], &desc, w->samples + pos * NUM_SENS_AXES, BENCH_FIFO_WATERMARK,
+                           (pos + 1) * SENSOR_SAMP_INTVL);
+    }
+    w->t_run = get_time_sec() - t_start;
+
+    return NULL;
+
+}
+
+
+/* Compare the worker placements of the batch and load modes for 1, 2, 4, ...
+*  threads up to the CPU count: default (one context array allocated and
+*  initialised by the main thread, threads not pinned) against NUMA (threads
+*  pinned per node, node-local contexts and copy of the signal)
+*  Input: None
+*  Output: None
+*/
+static void bench_numa(void)
+{
+    static bench_numa_t   work[BENCH_NUMA_MAX_THREADS];
+    pthread_t             threads[BENCH_NUMA_MAX_THREADS];
+    const unsigned int    num_algos = 64, num_samp = 16 * 1024;
+    const size_t          algos_size = num_algos * sizeof(step_algo_t);
+    const size_t          samples_size = num_samp * NUM_SENS_AXES * sizeof(float);
+    float                 *samples, *node_samples[NUMA_MAX_NODES];
+    step_algo_t           *shared;
+    unsigned int          num_threads, max_threads, p, t, a, n, steps[2];
+    unsigned int          save_place = NumaPlace;
+    long                  num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    double                t_max, rate[2], base[2] = { 0.0, 0.0 };
+
+    max_threads = (num_cpus > 0) ? (unsigned int)num_cpus : 1;
+    if (max_threads > BENCH_NUMA_MAX_THREADS)
+        max_threads = BENCH_NUMA_MAX_THREADS;
+    samples = malloc(samples_size);
+    shared = malloc(max_threads * algos_size);
+    if ((samples == NULL) || (shared == NULL)) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    bench_walk_signal(samples, num_samp);
+    NumaPlace = 1;
+    for (n = 0; n < NumaTopo.num_nodes; n++) {
+        node_samples[n] = numa_alloc(samples_size, (int)n);
+        if (node_samples[n] == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+        memcpy(node_samples[n], samples, samples_size);
+    }
+
+    printf("numa: %u nodes, %u contexts per thread, %u samples per context\n", NumaTopo.num_nodes, num_algos, num_samp);
+    for (num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+        /* pass 0 default placement, pass 1 NUMA placement */
+        for (p = 0; p < 2; p++) {
+            for (t = 0; t < num_threads; t++) {
+                work[t].num_algos = num_algos;
+                work[t].num_samp = num_samp;
+                if (p == 0) {
+                    work[t].node = -1;
+                    work[t].algos = shared + t * num_algos;
+                    work[t].samples = samples;
+                } else {
+                    work[t].node = numa_worker_node(t);
+                    work[t].algos = numa_alloc(algos_size, work[t].node);
+                    if (work[t].algos == NULL) {
+                        printf("Out of memory\n");
+                        exit(1);
+                    }
+                    work[t].samples = node_samples[work[t].node];
+                }
+                for (a = 0; a < num_algos; a++) {
+                    init_algo_out(&work[t].algos[a].out);
+                    step_algo_reset(&work[t].algos[a]);
+                }
+            }
+            for (t = 0; t < num_threads; t++) {
+                if (pthread_create(&threads[t], NULL, bench_numa_worker, &work[t]) != 0) {
+                    printf("Cannot create threads\n");
+                    exit(1);
+                }
+            }
+            t_max = 0.0;
+            for (t = 0; t < num_threads; t++) {
+                pthread_join(threads[t], NULL);
+                if (work[t].t_run > t_max)
+                    t_max = work[t].t_run;
+            }
+            rate[p] = (double)num_threads * num_algos * num_samp / t_max;
+            if (num_threads == 1)
+                base[p] = rate[p];
+            steps[p] = work[0].algos[0].out.step_count;
+            if (p == 1) {
+                for (t = 0; t < num_threads; t++)
+                    numa_free(work[t].algos, algos_size);
+            }
+        }
+        printf("numa: %2u threads, default %8.2f Msamples/s (scaling %5.2fx), numa %8.2f Msamples/s (scaling %5.2fx), "
+            "%+.1f%% (steps %u/%u)\n", num_threads, rate[0] * 1E-6, rate[0] / base[0], rate[1] * 1E-6,
+            rate[1] / base[1], (rate[1] / rate[0] - 1.0) * 100.0, steps[0], steps[1]);
+    }
+    NumaPlace = save_place;
+
+    for (n = 0; n < NumaTopo.num_nodes; n++)
+        numa_free(node_samples[n], samples_size);
+    free(shared);
+    free(samples);
+
+}
+
+
+/* Benchmark entry point
+*  Input: Arguments: [benchmark name], all benchmarks if none given
+*  Output: Exit code
+*/
+static int run_bench(int argc, char *argv[])
+{
+    static const struct {
+        const char  *name;
+        void        (*func)(void);
+    } benchmarks[] = {
+        { "classify", bench_classify },
+        { "denormal", bench_denormal },
+        { "push", bench_push },
+        { "handoff", bench_handoff },
+        { "perf", bench_perf },
+        { "simd", bench_simd },
+        { "session", bench_session },
+        { "numa", bench_numa },
+    };
+    unsigned int  b, found = 0;
+
+    printf("SIMD kernels: %s\n", SimdKernels->name);
+    for (b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++) {
+        if ((argc == 0) || (strcmp(argv[0], benchmarks[b].name) == 0)) {
+            benchmarks[b].func();
+            found = 1;
+        }
+    }
+    if (found == 0) {
+        printf("Unknown benchmark: %s\n", argv[0]);
+        return 1;
+    }
+
+    return 0;
+
+}
+
+
+/*
+  RAM footprint report
+
+  Bytes of one step_algo_t instance, the state of one sensor stream, per member
+  and against STEP_ALGO_RAM_BUDGET (also checked at compile time), and of the
+  state shared by all instances. Build with -DSTEP_ALGO_MIN_RAM for the
+  minimal RAM profile.
+*/
+
+#define FOOTPRINT_MEMBER(m)   printf("  %-16s %6u\n", #m, (unsigned int)sizeof(((step_algo_t *)0)->m))
+
+/* Print the RAM footprint report
+*  Input: None
+*  Output: Exit code
+*/
+static int run_footprint(void)
+{
+#if defined(STEP_ALGO_MIN_RAM)
+    printf("Profile: minimal RAM (STEP_ALGO_MIN_RAM)\n");
+#else
+    printf("Profile: default\n");
+#endif
+    printf("Bytes per instance (step_algo_t):\n");
+    FOOTPRINT_MEMBER(lp_filter_y);
+    FOOTPRINT_MEMBER(ll_filter_y);
+    FOOTPRINT_MEMBER(sos_filter_y);
+    FOOTPRINT_MEMBER(out);
+    FOOTPRINT_MEMBER(AccBuffCount);
+    FOOTPRINT_MEMBER(prevAccDer);
+    FOOTPRINT_MEMBER(AccBuffY);
+    FOOTPRINT_MEMBER(AccFilt);
+    FOOTPRINT_MEMBER(tick);
+#if !defined(STEP_ALGO_MIN_RAM)
+    FOOTPRINT_MEMBER(lp_filter_g);
+    FOOTPRINT_MEMBER(GravBaseline);
+    FOOTPRINT_MEMBER(AccBuffX);
+    FOOTPRINT_MEMBER(AccBuffZ);
+    FOOTPRINT_MEMBER(AccBuffTs);
+    FOOTPRINT_MEMBER(GyroBuff);
+    FOOTPRINT_MEMBER(RawBuff);
+    FOOTPRINT_MEMBER(TimeStamps);
+    FOOTPRINT_MEMBER(GyroFilt);
+    FOOTPRINT_MEMBER(AccDer);
+#endif
+    printf("  %-16s %6u (budget %u)\n", "total", (unsigned int)sizeof(step_algo_t), STEP_ALGO_RAM_BUDGET);
+
+    printf("Bytes of the ISR handoff ring (sample_ring_t): %u\n", (unsigned int)sizeof(sample_ring_t));
+    printf("Bytes shared by all instances:\n");
+    printf("  %-16s %6u\n", "SosFilterY", (unsigned int)sizeof(SosFilterY));
+#if !defined(STEP_ALGO_MIN_RAM)
+    printf("  %-16s %6u\n", "SpecCos/SpecSin", (unsigned int)(sizeof(SpecCos) + sizeof(SpecSin)));
+#endif
+
+    return 0;
+
+}
+
+
+/*
+  Energy model
+
+  Estimates the compute energy of the algorithm from operation counts. The
+  operation counting build (-DSTEP_ALGO_OPCOUNT) counts the multiply-adds,
+  compares, divides and memory accesses of the filters, step_algo_preproc and
+  step_algo_run at source level; --energy processes the input files with the
+  preprocessing options given and weighs the counts with per operation costs
+  (pJ) to an energy per hour of data. Compare BUFF_FACTOR choices by building
+  with -DBUFF_FACTOR=n.
+*/
+
+/* Energy model entry point
+*  Input: Arguments: [-c mac:cmp:div:mem] inputfile [inputfile ...], costs in pJ
+*  Output: Exit code
+*/
+static int run_energy(int argc, char *argv[])
+{
+#if defined(STEP_ALGO_OPCOUNT)
+    static const char   *stage_name[NUM_OPS_STAGES] = { "filter", "preproc", "run" };
+    static step_algo_t  algo;
+    float               cost[NUM_OPS_TYPES] = { ENERGY_MAC_PJ, ENERGY_CMP_PJ, ENERGY_DIV_PJ, ENERGY_MEM_PJ };
+    double              total[NUM_OPS_TYPES] = { 0 };
+    double              energy, energy_total = 0.0;
+    FILE                *fpin;
+    sens_data_t         sens_data;
+    float               timestamp;
+    unsigned long       num_samp = 0, num_blocks = 0;
+    unsigned int        s, op;
+    int                 f;
+
+    if ((argc >= 2) && (strcmp(argv[0], "-c") == 0)) {
+        if (sscanf(argv[1], "%f:%f:%f:%f", &cost[OPS_MAC], &cost[OPS_CMP], &cost[OPS_DIV], &cost[OPS_MEM]) != 4) {
+            printf("Invalid costs: %s\n", argv[1]);
+            return 1;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc < 1) {
+        printf("Usage: --energy [-c mac:cmp:div:mem] inputfile [inputfile ...]\n");
+        return 1;
+    }
+
+    memset(OpCount, 0, sizeof(OpCount));
+    for (f = 0; f < argc; f++) {
+        fpin = fopen(argv[f], "r");
+        if (fpin == NULL) {
+            printf("Cannot open input file: %s\n", argv[f]);
+            return 1;
+        }
+        if (skip_header(fpin) != 0) {
+            printf("Cannot read first two lines of input file: %s\n", argv[f]);
+            return 1;
+        }
+        init_algo_out(&algo.out);
+        step_algo_reset(&algo);
+        timestamp = 0.0f;
+        while (read_sens_data(fpin, &sens_data) == 0) {
+            timestamp += SENSOR_SAMP_INTVL;
+            if (step_algo_preproc(&algo, timestamp, sens_data.arx, sens_data.ary, sens_data.arz,
+                                  sens_data.grx, sens_data.gry, sens_data.grz) == 1) {
+                step_algo_run(&algo);
+                num_blocks++;
+            }
+            num_samp++;
+        }
+        if (step_algo_finalize(&algo) > 0)
+            num_blocks++;
+        fclose(fpin);
+    }
+    if ((num_samp == 0) || (num_blocks == 0)) {
+        printf("No sensor data\n");
+        return 1;
+    }
+
+    printf("%lu samples, %lu blocks (BUFF_FACTOR %d), costs in pJ: mac %.2f, cmp %.2f, div %.2f, mem %.2f\n",
+        num_samp, num_blocks, BUFF_FACTOR, cost[OPS_MAC], cost[OPS_CMP], cost[OPS_DIV], cost[OPS_MEM]);
+    printf("%-8s %31s  %40s %12s %12s\n", "stage", "per sample mac/cmp/div/mem", "per block mac/cmp/div/mem",
+        "pJ/sample", "mJ/hour");
+    for (s = 0; s <= NUM_OPS_STAGES; s++) {
+        energy = 0.0;
+        for (op = 0; op < NUM_OPS_TYPES; op++) {
+            if (s < NUM_OPS_STAGES) {
+                energy += (double)OpCount[s][op] * cost[op];
+                total[op] += OpCount[s][op];
+            }
+            else
+                energy += total[op] * cost[op];
+        }
+        energy = energy / num_samp;
+        if (s < NUM_OPS_STAGES) {
+            energy_total += energy;
+            printf("%-8s %7.2f %7.2f %7.3f %7.2f  %9.1f %9.1f %8.2f %9.1f %12.2f %12.3f\n", stage_name[s],
+                (double)OpCount[s][OPS_MAC] / num_samp, (double)OpCount[s][OPS_CMP] / num_samp,
+                (double)OpCount[s][OPS_DIV] / num_samp, (double)OpCount[s][OPS_MEM] / num_samp,
+                (double)OpCount[s][OPS_MAC] / num_blocks, (double)OpCount[s][OPS_CMP] / num_blocks,
+                (double)OpCount[s][OPS_DIV] / num_blocks, (double)OpCount[s][OPS_MEM] / num_blocks,
+                energy, energy * SENSOR_SAMP_FREQ * 3600 * 1E-9);
+        }
+        else
+            printf("%-8s %7.2f %7.2f %7.3f %7.2f  %9.1f %9.1f %8.2f %9.1f %12.2f %12.3f\n", "total",
+                total[OPS_MAC] / num_samp, total[OPS_CMP] / num_samp, total[OPS_DIV] / num_samp,
+                total[OPS_MEM] / num_samp, total[OPS_MAC] / num_blocks, total[OPS_CMP] / num_blocks,
+                total[OPS_DIV] / num_blocks, total[OPS_MEM] / num_blocks,
+                energy_total, energy_total * SENSOR_SAMP_FREQ * 3600 * 1E-9);
+    }
+
+    return 0;
+#else
+    (void)argc;
+    (void)argv;
+    printf("--energy needs the operation counting build, compile with -DSTEP_ALGO_OPCOUNT\n");
+    return 1;
+#endif
+
+}
+
+
+/*
+  Real-time replay
+
+  Replays recordings through the live ingestion path: a producer thread plays
+  the sensor interrupt and puts the samples into the sample ring at the sensor
+  rate (or N times faster) on the monotonic clock, the main loop wakes up
+  REPLAY_POLL_DIV times per sample interval, drains the ring, runs the
+  algorithm and flushes a stalled stream as on the device. Each step is timed
+  from the arrival of the sample where its min value occurred to the main loop
+  iteration that reported it.
+*/
+
+/* State shared by the replay producer thread and the main loop */
+typedef struct {
+    sample_ring_t         ring;
+    const float           *samples;        /* NUM_SENS_AXES interleaved per sample */
+    unsigned int          num_samp;
+    double                t_start;         /* monotonic time of the first sample, sec */
+    double                samp_intvl;      /* wall time between samples, sec */
+    double                *arrival;        /* monotonic time each sample was put, sec */
+    unsigned long         producer_waits;
+} replay_t;
+
+/* Append the samples of a recording to an interleaved sample array
+*  Input: File name, sample array, its length and allocated length (all updated)
+*  Output: 0 on success, -1 if the file cannot be read
+*/
+static int replay_load(const char *fname, float **samples, unsigned int *num_samp, unsigned int *max_samp)
+{
+    FILE          *fpin;
+    sens_data_t   sens_data;
+    float         *s;
+
+    fpin = fopen(fname, "r");
+    if (fpin == NULL)
+        return -1;
+    if (skip_header(fpin) != 0) {
+        fclose(fpin);
+        return -1;
+    }
+    while (read_sens_data(fpin, &sens_data) == 0) {
+        if (*num_samp == *max_samp) {
+            *max_samp = (*max_samp == 0) ? 1024 : 2 * *max_samp;
+            *samples = realloc(*samples, *max_samp * NUM_SENS_AXES * sizeof(float));
+            if (*samples == NULL) {
+                printf("Out of memory\n");
+                exit(1);
+            }
+        }
+        s = *samples + *num_samp * NUM_SENS_AXES;
+        s[CHX] = sens_data.arx;
+        s[CHY] = sens_data.ary;
+        s[CHZ] = sens_data.arz;
+        s[NUM_DIM + CHX] = sens_data.grx;
+        s[NUM_DIM + CHY] = sens_data.gry;
+        s[NUM_DIM + CHZ] = sens_data.grz;
+        (*num_samp)++;
+    }
+    fclose(fpin);
+
+    return 0;
+
+}
+
+
+/* Sleep until the monotonic time t in sec */
+static void replay_sleep_until(double t)
+{
+    struct timespec  ts;
+
+    ts.tv_sec = (time_t)t;
+    ts.tv_nsec = (long)((t - ts.tv_sec) * 1E9);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+
+/* Producer thread of the replay, plays the sensor interrupt: puts one sample
+*  per sample interval, retries (and counts) while the ring is full
+*  Input: Pointer to replay_t
+*  Output: NULL
+*/
+static void *replay_producer(void *arg)
+{
+    replay_t              *r = (replay_t *)arg;
+    const float           *s;
+    unsigned int          i;
+
+    for (i = 0; i < r->num_samp; i++) {
+        replay_sleep_until(r->t_start + i * r->samp_intvl);
+        s = r->samples + i * NUM_SENS_AXES;
+        /* written before the sample is published, read by the main loop after */
+        r->arrival[i] = get_time_sec();
+        while (sample_ring_put(&r->ring, s[0], s[1], s[2], s[3], s[4], s[5]) != 0) {
+            r->producer_waits++;
+            sched_yield();
+        }
+    }
+
+    return NULL;
+
+}
+
+
+/* Collect the latency of the steps reported since the last call, from the
+*  step min samples of the last algo run. Steps that cannot be attributed
+*  to a sample (more than one algo run per main loop iteration or more than
+*  MAX_BLOCK_STEPS per run) are only counted.
+*  Input: Replay state, algo output, step count at the last call (updated),
+*         latency array and its length (updated), unattributed step count (updated)
+*  Output: None
+*/
+static void replay_collect(const replay_t *r, const algo_out_t *out, unsigned int *step_count,
+                           double *latency, unsigned int *num_lat, unsigned int *unattributed)
+{
+    double        t_report = get_time_sec();
+    unsigned int  new_steps = out->step_count - *step_count;
+    unsigned int  j, num_ts;
+    long          idx;
+
+    if (new_steps == 0)
+        return;
+    num_ts = out->num_block_steps;
+    if (num_ts > MAX_BLOCK_STEPS)
+        num_ts = MAX_BLOCK_STEPS;
+    if (num_ts > new_steps)
+        num_ts = new_steps;
+    for (j = 0; j < num_ts; j++) {
+        idx = (long)out->block_step_samp[j];
+        if ((idx < 0) || (idx >= (long)r->num_samp)) {
+            (*unattributed)++;
+            continue;
+        }
+        latency[(*num_lat)++] = t_report - r->arrival[idx];
+    }
+    *unattributed += new_steps - num_ts;
+    *step_count = out->step_count;
+
+}
+
+
+/* Compare two doubles for qsort */
+static int replay_cmp(const void *a, const void *b)
+{
+    double  x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+/* Print the latency distribution of one replay
+*  Input: Name, latencies in sec (sorted on return), number of latencies,
+*         wall time between samples in sec, unattributed step count
+*  Output: None
+*/
+static void replay_print(const char *name, double *latency, unsigned int num_lat, double samp_intvl,
+                         unsigned int unattributed)
+{
+    double        mean = 0.0, var = 0.0;
+    unsigned int  i;
+
+    if (num_lat == 0) {
+        printf("%-44s %6u %7u  no steps timed\n", name, 0, unattributed);
+        return;
+    }
+    qsort(latency, num_lat, sizeof(double), replay_cmp);
+    for (i = 0; i < num_lat; i++)
+        mean += latency[i];
+    mean = mean / num_lat;
+    for (i = 0; i < num_lat; i++)
+        var += (latency[i] - mean) * (latency[i] - mean);
+    var = var / num_lat;
+
+    printf("%-44s %6u %7u %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.2f %8.1f\n", name, num_lat, unattributed,
+        latency[0] * 1E3, latency[num_lat / 2] * 1E3, latency[(num_lat * 90) / 100] * 1E3,
+        latency[(num_lat * 99) / 100] * 1E3, latency[num_lat - 1] * 1E3, mean * 1E3, sqrt(var) * 1E3,
+        mean / samp_intvl);
+
+}
+
+
+/* Real-time replay entry point
+*  Input: Arguments: [-x speedup] inputfile [inputfile ...]
+*  Output: Exit code
+*/
+static int run_replay(int argc, char *argv[])
+{
+    static replay_t     r;
+    static step_algo_t  algo;
+    pthread_t           producer;
+    float               *samples = NULL;
+    double              *latency = NULL, *all_latency = NULL;
+    double              speedup = 1.0, poll_intvl, t_next, elapsed;
+    float               timestamp;
+    unsigned int        num_samp, max_samp = 0, consumed, step_count;
+    unsigned int        num_lat, num_all = 0, max_all = 0, unattributed, all_unattributed = 0;
+    int                 f;
+
+    if ((argc >= 2) && (strcmp(argv[0], "-x") == 0)) {
+        speedup = atof(argv[1]);
+        if (speedup <= 0.0) {
+            printf("Invalid speedup: %s\n", argv[1]);
+            return 1;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc < 1) {
+        printf("Usage: --replay [-x speedup] inputfile [inputfile ...]\n");
+        return 1;
+    }
+
+    r.samp_intvl = SENSOR_SAMP_INTVL / speedup;
+    poll_intvl = r.samp_intvl / REPLAY_POLL_DIV;
+    printf("Replay at %.1f Hz (%gx), latency from the arrival of the step min sample to the step report\n",
+        SENSOR_SAMP_FREQ * speedup, speedup);
+    printf("%-44s %6s %7s %8s %8s %8s %8s %8s %8s %8s %8s\n", "file", "timed", "untimed", "min ms", "p50 ms",
+        "p90 ms", "p99 ms", "max ms", "mean ms", "jitter", "samples");
+
+    for (f = 0; f < argc; f++) {
+        /* Load the whole recording, the replay must not wait on file IO */
+        num_samp = 0;
+        if (replay_load(argv[f], &samples, &num_samp, &max_samp) != 0) {
+            printf("Cannot read input file: %s\n", argv[f]);
+            return 1;
+        }
+        r.arrival = realloc(r.arrival, max_samp * sizeof(double));
+        latency = realloc(latency, max_samp * sizeof(double));
+        if ((r.arrival == NULL) || (latency == NULL)) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+
+        sample_ring_init(&r.ring);
+        init_algo_out(&algo.out);
+        step_algo_reset(&algo);
+        r.samples = samples;
+        r.num_samp = num_samp;
+        r.producer_waits = 0;
+        r.t_start = get_time_sec() + r.samp_intvl;
+        if (pthread_create(&producer, NULL, replay_producer, &r) != 0) {
+            printf("Cannot create threads\n");
+            exit(1);
+        }
+
+        /* Main loop: drain the ring, flush the buffer once the stream stalls */
+        consumed = 0;
+        step_count = 0;
+        num_lat = 0;
+        unattributed = 0;
+        timestamp = 0.0f;
+        t_next = r.t_start;
+        while ((consumed < num_samp) || (algo.AccBuffCount > 0)) {
+            t_next += poll_intvl;
+            replay_sleep_until(t_next);
+            consumed += sample_ring_drain(&r.ring, &algo, &timestamp);
+            replay_collect(&r, &algo.out, &step_count, latency, &num_lat, &unattributed);
+            /* samples due now on the sample clock */
+            elapsed = get_time_sec() - r.t_start;
+            if (step_algo_poll(&algo, (elapsed >= 0.0) ? (unsigned int)(elapsed / r.samp_intvl) + 1 : 0) > 0)
+                replay_collect(&r, &algo.out, &step_count, latency, &num_lat, &unattributed);
+        }
+        pthread_join(producer, NULL);
+        if (r.producer_waits > 0)
+            printf("%s: %lu producer waits (ring full, main loop too slow)\n", argv[f], r.producer_waits);
+
+        if (num_all + num_lat > max_all) {
+            max_all = num_all + num_lat;
+            all_latency = realloc(all_latency, max_all * sizeof(double));
+            if (all_latency == NULL) {
+                printf("Out of memory\n");
+                exit(1);
+            }
+        }
+        if (num_lat > 0)
+            memcpy(all_latency + num_all, latency, num_lat * sizeof(double));
+        num_all += num_lat;
+        all_unattributed += unattributed;
+        replay_print(argv[f], latency, num_lat, r.samp_intvl, unattributed);
+    }
+    if (argc > 1)
+        replay_print("all", all_latency, num_all, r.samp_intvl, all_unattributed);
+
+    free(samples);
+    free(r.arrival);
+    free(latency);
+    free(all_latency);
+
+    return 0;
+
+}
+
+
+/*
+  Load generator
+
+  Simulates N devices streaming to one node, each with its own algorithm
+  instance fed through step_algo_push with a FIFO burst every
+  BENCH_FIFO_WATERMARK samples at the sensor rate (or speedup times faster).
+  The devices replay the recordings (or a synthetic walk) time shifted
+  against each other, their bursts are spread over the burst interval and
+  served by a pool of worker threads. N doubles every round until the workers
+  fall behind or the max device count is reached; each round reports the CPU
+  cost per stream and the queueing delay from burst arrival to processing.
+  Every worker owns its devices (device d is served by worker d % threads),
+  with --numa on they are allocated on the node of the worker together with
+  a node-local copy of the recording.
+*/
+
+#define LOAD_MAX_THREADS      ( 64 )
+#define LOAD_HIST_BINS        ( 2000 )
+#define LOAD_HIST_BIN_SEC     ( 1E-4 )        /* queueing delay histogram, 0.1 ms bins */
+
+/* One simulated device */
+typedef struct {
+    step_algo_t           algo;
+    unsigned int          pos;               /* next sample in the shared recording */
+    double                due;               /* arrival time of the next burst, sec */
+    float                 timestamp;         /* of the last pushed sample, sec */
+} load_dev_t;
+
+/* Work and statistics of one worker thread */
+typedef struct {
+    load_dev_t            *devs;             /* own devices, on the node of the worker */
+    unsigned int          num_devs;
+    int                   node;              /* NUMA node, -1 for the default placement */
+    const float           *samples;
+    unsigned int          num_samp;
+    double                burst_intvl, t_end;
+    double                cpu_sec;
+    double                delay_sum, delay_max;
+    unsigned long         bursts;
+    unsigned long         hist[LOAD_HIST_BINS + 1];
+} load_work_t;
+
+/* CPU time of the calling thread in sec */
+static double load_thread_cpu_sec(void)
+{
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+
+/* Worker thread of the load generator, serves its devices in order of
+*  burst arrival until t_end
+*  Input: Pointer to load_work_t
+*  Output: NULL
+*/
+static void *load_worker(void *arg)
+{
+    static const fifo_desc_t  desc = { FIFO_FLOAT, NUM_SENS_AXES, 1.0f, 1.0f };
+    load_work_t           *w = (load_work_t *)arg;
+    load_dev_t            *dev;
+    double                cpu_start = load_thread_cpu_sec();
+    double                now, next_due, delay;
+    unsigned int          d, len, rem;
+
+    numa_pin(w->node);
+    while (1) {
+        now = get_time_sec();
+        if (now >= w->t_end)
+            break;
+        next_due = w->t_end;
+        for (d = 0; d < w->num_devs; d++) {
+            dev = &w->devs[d];
+            while (dev->due <= now) {
+                delay = get_time_sec() - dev->due;
+                w->delay_sum += delay;
+                if (delay > w->delay_max)
+                    w->delay_max = delay;
+                w->hist[(delay < LOAD_HIST_BINS * LOAD_HIST_BIN_SEC) ? (unsigned int)(delay / LOAD_HIST_BIN_SEC) : LOAD_HIST_BINS]++;
+                w->bursts++;
+                /* the burst wraps around at the end of the recording */
+                for (rem = BENCH_FIFO_WATERMARK; rem > 0; rem -= len) {
+                    len = w->num_samp - dev->pos;
+                    if (len > rem)
+                        len = rem;
+                    step_algo_push(&dev->algo, &desc, w->samples + dev->pos * NUM_SENS_AXES, len,
+                                   dev->timestamp + SENSOR_SAMP_INTVL);
+                    dev->timestamp += len * SENSOR_SAMP_INTVL;
+                    dev->pos = (dev->pos + len) % w->num_samp;
+                }
+                dev->due += w->burst_intvl;
+            }
+            if (dev->due < next_due)
+                next_due = dev->due;
+        }
+        replay_sleep_until(next_due);
+    }
+    w->cpu_sec = load_thread_cpu_sec() - cpu_start;
+
+    return NULL;
+
+}
+
+
+/* Load generator entry point
+*  Input: Arguments: [-j threads] [-x speedup] [-t seconds] [-n max_devices] [inputfile ...]
+*  Output: Exit code
+*/
+static int run_load(int argc, char *argv[])
+{
+    static load_work_t  work[LOAD_MAX_THREADS];
+    pthread_t           threads[LOAD_MAX_THREADS];
+    load_dev_t          *devs[LOAD_MAX_THREADS];
+    float               *samples = NULL, *node_samples[NUMA_MAX_NODES];
+    size_t              devs_size, samples_size;
+    unsigned int        num_samp = 0, max_samp = 0, num_nodes = 0;
+    unsigned int        num_threads = 0, max_devs = 4096, num_devs, d, t, b;
+    unsigned long       bursts, hist[LOAD_HIST_BINS + 1], count;
+    double              speedup = 1.0, duration = 5.0, burst_intvl, t_start, wall;
+    double              cpu, delay_sum, delay_max, p99, lag, streams;
+    int                 f, overload = 0;
+
+    while ((argc >= 2) && (argv[0][0] == '-') && (argv[0][1] != '\0') && (argv[0][2] == '\0')) {
+        if (argv[0][1] == 'j')
+            num_threads = (unsigned int)atoi(argv[1]);
+        else if (argv[0][1] == 'x')
+            speedup = atof(argv[1]);
+        else if (argv[0][1] == 't')
+            duration = atof(argv[1]);
+        else if (argv[0][1] == 'n')
+            max_devs = (unsigned int)atoi(argv[1]);
+        else
+            break;
+        argc -= 2;
+        argv += 2;
+    }
+    if ((speedup <= 0.0) || (duration <= 0.0) || (max_devs == 0) || ((argc > 0) && (argv[0][0] == '-'))) {
+        printf("Usage: --load [-j threads] [-x speedup] [-t seconds] [-n max_devices] [inputfile ...]\n");
+        return 1;
+    }
+    /* Devices would interleave their records in the one feature file */
+    if (FeatFile != NULL) {
+        printf("--features is not supported with --load, export the features of one recording at a time\n");
+        return 1;
+    }
+    if (num_threads == 0) {
+        long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = (num_cpus > 0) ? (unsigned int)num_cpus : 1;
+    }
+    if (num_threads > LOAD_MAX_THREADS)
+        num_threads = LOAD_MAX_THREADS;
+
+    /* All devices share one read only recording, concatenated input files */
+    for (f = 0; f < argc; f++) {
+        if (replay_load(argv[f], &samples, &num_samp, &max_samp) != 0) {
+            printf("Cannot read input file: %s\n", argv[f]);
+            return 1;
+        }
+    }
+    if (argc == 0) {
+        num_samp = 64 * 1024;
+        samples = malloc(num_samp * NUM_SENS_AXES * sizeof(float));
+        if (samples == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+        bench_walk_signal(samples, num_samp);
+    }
+    if (num_samp < BENCH_FIFO_WATERMARK) {
+        printf("Not enough sensor data\n");
+        return 1;
+    }
+
+    /* Devices of every worker and a copy of the recording on every node in use */
+    devs_size = ((max_devs + num_threads - 1) / num_threads) * sizeof(load_dev_t);
+    samples_size = (size_t)num_samp * NUM_SENS_AXES * sizeof(float);
+    for (t = 0; t < num_threads; t++) {
+        memset(&work[t], 0, sizeof(work[t]));
+        work[t].node = numa_worker_node(t);
+        devs[t] = numa_alloc(devs_size, work[t].node);
+        if (devs[t] == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+        if (work[t].node < 0) {
+            work[t].samples = samples;
+        } else {
+            if ((unsigned int)work[t].node >= num_nodes) {
+                node_samples[num_nodes] = numa_alloc(samples_size, work[t].node);
+                if (node_samples[num_nodes] == NULL) {
+                    printf("Out of memory\n");
+                    exit(1);
+                }
+                memcpy(node_samples[num_nodes], samples, samples_size);
+                num_nodes++;
+            }
+            work[t].samples = node_samples[work[t].node];
+        }
+    }
+
+    burst_intvl = BENCH_FIFO_WATERMARK * SENSOR_SAMP_INTVL / speedup;
+    printf("Load: %u worker threads on %u NUMA nodes, bursts of %d samples every %.2f ms per device (%gx real time), %.1f s per round\n",
+        num_threads, (num_nodes > 0) ? num_nodes : 1, BENCH_FIFO_WATERMARK, burst_intvl * 1E3, speedup, duration);
+    printf("%8s %10s %8s %12s %14s %10s %10s %10s %10s  %s\n", "devices", "streams", "cpu %", "us/stream-s",
+        "streams/core", "mean ms", "p99 ms", "max ms", "lag ms", "status");
+
+    for (num_devs = 1; (num_devs <= max_devs) && (overload == 0); num_devs *= 2) {
+        t_start = get_time_sec() + 0.01;
+        for (t = 0; t < num_threads; t++) {
+            work[t].num_devs = 0;
+            work[t].cpu_sec = work[t].delay_sum = work[t].delay_max = 0.0;
+            work[t].bursts = 0;
+            memset(work[t].hist, 0, sizeof(work[t].hist));
+        }
+        for (d = 0; d < num_devs; d++) {
+            load_work_t  *w = &work[d % num_threads];
+            load_dev_t   *dev = &devs[d % num_threads][w->num_devs++];
+
+            init_algo_out(&dev->algo.out);
+            step_algo_reset(&dev->algo);
+            /* time shift the recording and spread the bursts over the interval */
+            dev->pos = (unsigned int)(((unsigned long long)d * 7919) % num_samp);
+            dev->due = t_start + burst_intvl * d / num_devs;
+            dev->timestamp = 0.0f;
+        }
+        for (t = 0; t < num_threads; t++) {
+            work[t].devs = devs[t];
+            work[t].num_samp = num_samp;
+            work[t].burst_intvl = burst_intvl;
+            work[t].t_end = t_start + duration;
+            if (pthread_create(&threads[t], NULL, load_worker, &work[t]) != 0) {
+                printf("Cannot create threads\n");
+                exit(1);
+            }
+        }
+        cpu = delay_sum = delay_max = 0.0;
+        bursts = 0;
+        memset(hist, 0, sizeof(hist));
+        for (t = 0; t < num_threads; t++) {
+            pthread_join(threads[t], NULL);
+            cpu += work[t].cpu_sec;
+            delay_sum += work[t].delay_sum;
+            if (work[t].delay_max > delay_max)
+                delay_max = work[t].delay_max;
+            bursts += work[t].bursts;
+            for (b = 0; b <= LOAD_HIST_BINS; b++)
+                hist[b] += work[t].hist[b];
+        }
+        wall = get_time_sec() - t_start;
+
+        /* p99 queueing delay (upper bin edge, the max beyond the histogram) */
+        /* and the backlog left at the end                                   */
+        p99 = delay_max;
+        for (b = 0, count = 0; b < LOAD_HIST_BINS; b++) {
+            count += hist[b];
+            if (count * 100 >= bursts * 99) {
+                p99 = (b + 1) * LOAD_HIST_BIN_SEC;
+                break;
+            }
+        }
+        lag = 0.0;
+        for (t = 0; t < num_threads; t++) {
+            for (d = 0; d < work[t].num_devs; d++) {
+                if (t_start + duration - devs[t][d].due > lag)
+                    lag = t_start + duration - devs[t][d].due;
+            }
+        }
+        /* the workers keep up if no device is more than one burst behind */
+        overload = (lag > burst_intvl) ? 1 : 0;
+
+        streams = num_devs * speedup;
+        printf("%8u %10.0f %8.1f %12.2f %14.0f %10.3f %10.3f %10.3f %10.3f  %s\n", num_devs, streams,
+            cpu * 100.0 / wall, cpu * 1E6 / (streams * wall), (cpu > 0.0) ? streams * wall / cpu : 0.0,
+            (bursts > 0) ? delay_sum * 1E3 / bursts : 0.0, p99 * 1E3, delay_max * 1E3, lag * 1E3,
+            (overload == 0) ? "sustained" : "overload");
+    }
+
+    for (t = 0; t < num_threads; t++)
+        numa_free(devs[t], devs_size);
+    for (b = 0; b < num_nodes; b++)
+        numa_free(node_samples[b], samples_size);
+    free(samples);
+
+    return 0;
+
+}
+
+
+/*
+  Differential check
+
+  Runs the reference path (scalar kernels, step_algo_preproc per sample, the
+  2nd order filter of apply_filter) side by side with the optimised paths
+  (every SIMD kernel variant the build and CPU support, step_algo_push with
+  random burst sizes and the cascaded filter engine loaded with the same
+  coefficients) over the input files and randomised synthetic signals.
+
+  In the bit-exact mode step_count, step_type and the steps per type have to
+  be equal after every burst and the filtered data may only diverge by
+  DIFF_FILTER_TOL (relative). The fast mode (STEP_ALGO_FAST_MATH) evaluates
+  the two filter paths in different order, so a step close to a threshold
+  may go either way: there the filtered data has to stay within
+  DIFF_FILTER_TOL and the step count of every input within DIFF_STEP_TOL.
+
+  The reference path of one build can be written to a trace file (-w) and
+  checked by another build (-t), e.g. the fast mode against the bit-exact
+  mode or ARM against x86. Two bit-exact builds of the same profile have to
+  match run by run, otherwise the fast mode bounds apply (the minimal RAM
+  profile derives its timestamps from a tick counter, which moves the time
+  thresholds slightly on long inputs). The synthetic signals are generated
+  by each build, so check the recordings only (-n 0) when the builds may
+  differ in the signal generation.
+*/
+
+#define DIFF_MAX_BURST        ( 64 )          /* samples per push of the optimised path */
+#define DIFF_FILTER_TOL       ( 1E-4f )       /* max relative divergence of filtered data */
+#define DIFF_STEP_TOL         ( 0.01f )       /* max relative step count deviation, fast mode (min 1 step) */
+#define DIFF_NUM_SIGNALS      ( 20 )          /* synthetic signals by default */
+#define DIFF_TRACE_MAGIC      ( 0x54444550 )  /* "PEDT" */
+#define DIFF_TRACE_VERSION    ( 1 )
+
+#if defined(STEP_ALGO_FAST_MATH)
+#define DIFF_FAST_MATH        ( 1 )
+#else
+#define DIFF_FAST_MATH        ( 0 )
+#endif
+#if defined(STEP_ALGO_MIN_RAM)
+#define DIFF_MIN_RAM          ( 2 )
+#else
+#define DIFF_MIN_RAM          ( 0 )
+#endif
+#define DIFF_BUILD_FLAGS      ( DIFF_FAST_MATH | DIFF_MIN_RAM )   /* trace header: build of the trace */
+
+/* Trace of the reference path: per algo run step_count, step_type, number of */
+/* samples and the filtered samples, written (-w) or checked (-t)            */
+typedef struct {
+    FILE                  *fp;
+    int                   write;
+    int                   strict;       /* both builds bit-exact, same profile */
+    unsigned long         runs;
+    unsigned long         step_mismatch;
+    unsigned int          steps;        /* step_count of the last run in the trace */
+    float                 max_div;
+    int                   broken;       /* trace ended or does not match in layout */
+} diff_trace_t;
+
+/* Random number in [lo, hi) from a private generator */
+static float diff_rand(unsigned int *seed, float lo, float hi)
+{
+    return lo + (hi - lo) * ((float)rand_r(seed) / ((float)RAND_MAX + 1.0f));
+}
+
+
+/* Synthetic test signal: segments of 2 to 20 sec of stationary data, gait at
+*  random frequency, amplitude and noise, or bursts of random spikes
+*  Input: Output array (num_samp * NUM_SENS_AXES), number of samples, seed
+*  Output: None
+*/
+static void diff_synth_signal(float *samples, unsigned int num_samp, unsigned int *seed)
+{
+    unsigned int  i = 0, end, ax, kind;
+    float         freq = 0.0f, amp = 0.0f, noise = 0.0f, phase = 0.0f;
+    float         *s;
+
+    while (i < num_samp) {
+        end = i + (unsigned int)diff_rand(seed, 2.0f, 20.0f) * SENSOR_SAMP_FREQ;
+        if (end > num_samp)
+            end = num_samp;
+        kind = rand_r(seed) % 3;
+        if (kind == 0) {
+            amp = 0.0f;
+            noise = 0.01f;
+        }
+        else {
+            freq = diff_rand(seed, 0.5f, 3.5f);
+            amp = diff_rand(seed, 0.5f, 12.0f);
+            noise = diff_rand(seed, 0.0f, 1.5f);
+        }
+        for (; i < end; i++) {
+            s = samples + i * NUM_SENS_AXES;
+            phase += 2.0f * (float)M_PI * freq / SENSOR_SAMP_FREQ;
+            s[CHY] = 9.81f + amp * sinf(phase) + diff_rand(seed, -noise, noise);
+            if ((kind == 2) && ((rand_r(seed) % 16) == 0))
+                s[CHY] += diff_rand(seed, -20.0f, 20.0f);
+            s[CHX] = 0.3f * amp * cosf(phase) + diff_rand(seed, -noise, noise);
+            s[CHZ] = diff_rand(seed, -noise, noise);
+            for (ax = NUM_DIM; ax < NUM_SENS_AXES; ax++)
+                s[ax] = 0.2f * amp * sinf(phase + ax) + diff_rand(seed, -noise, noise);
+        }
+    }
+
+}
+
+
+/* Write or check the trace record of the algo run just done
+*  Input: Trace, algo instance, number of samples of the run
+*  Output: None
+*/
+static void diff_trace_block(diff_trace_t *trace, const step_algo_t *algo, unsigned int num_samp)
+{
+    const float   *filt = algo->AccFilt + algo->ll_filter_y.TC_samples;
+    unsigned int  hdr[3], i;
+    float         val, div;
+
+    if ((trace == NULL) || (trace->broken != 0))
+        return;
+    hdr[0] = algo->out.step_count;
+    hdr[1] = (unsigned int)algo->out.step_type;
+    hdr[2] = num_samp;
+    if (trace->write == 1) {
+        fwrite(hdr, sizeof(hdr), 1, trace->fp);
+        fwrite(filt, sizeof(float), num_samp, trace->fp);
+        return;
+    }
+
+    trace->runs++;
+    if ((fread(hdr, sizeof(hdr), 1, trace->fp) != 1) || (hdr[2] != num_samp)) {
+        trace->broken = 1;
+        return;
+    }
+    trace->steps = hdr[0];
+    if ((hdr[0] != algo->out.step_count) || (hdr[1] != (unsigned int)algo->out.step_type))
+        trace->step_mismatch++;
+    for (i = 0; i < num_samp; i++) {
+        if (fread(&val, sizeof(val), 1, trace->fp) != 1) {
+            trace->broken = 1;
+            return;
+        }
+        div = fabsf(filt[i] - val) / (1.0f + fabsf(val));
+        if (div > trace->max_div)
+            trace->max_div = div;
+    }
+
+}
+
+
+/* Compare the algo outputs and the filtered data of two instances
+*  Input: Reference and optimised instance, max divergence so far (updated)
+*  Output: 0 if the step outputs are equal
+*/
+static int diff_compare(const step_algo_t *ref, const step_algo_t *opt, float *max_div)
+{
+    unsigned int  i;
+    float         div;
+
+    for (i = 0; i < SAMP_BUFF_LEN + MAX_TC_SAMPLES; i++) {
+        div = fabsf(opt->AccFilt[i] - ref->AccFilt[i]) / (1.0f + fabsf(ref->AccFilt[i]));
+        if (div > *max_div)
+            *max_div = div;
+    }
+    if ((ref->out.step_count != opt->out.step_count) || (ref->out.step_type != opt->out.step_type) ||
+        (memcmp(ref->out.type_steps, opt->out.type_steps, sizeof(ref->out.type_steps)) != 0))
+        return -1;
+
+    return 0;
+
+}
+
+
+/* Check the fast mode bounds: filtered data within DIFF_FILTER_TOL and the
+*  step count within DIFF_STEP_TOL of the reference
+*  Input: Reference and checked step count, max filter divergence
+*  Output: 1 if within bounds
+*/
+static int diff_in_bounds(unsigned int ref_steps, unsigned int steps, float max_div)
+{
+    unsigned int  dev = (steps > ref_steps) ? steps - ref_steps : ref_steps - steps;
+
+    return (max_div <= DIFF_FILTER_TOL) && ((dev <= 1) || (dev <= DIFF_STEP_TOL * ref_steps));
+
+}
+
+
+/* Run the reference and every optimised path over one input
+*  Input: Input name, interleaved samples, number of samples, seed of the burst
+*         sizes, trace of the reference path (or NULL)
+*  Output: Number of optimised paths (and traces) out of bounds
+*/
+static int diff_run(const char *name, const float *samples, unsigned int num_samp, unsigned int seed,
+                    diff_trace_t *trace)
+{
+    static const fifo_desc_t  desc = { FIFO_FLOAT, NUM_SENS_AXES, 1.0f, 1.0f };
+    static step_algo_t    ref, opt;
+    const simd_kernels_t  *selected = SimdKernels;
+    const simd_kernels_t  *opt_kernels;
+    filter_t              lp_filter;
+    const float           *s;
+    float                 timestamp, max_div;
+    unsigned int          v, pos, burst, i, first_diff;
+    int                   failed = 0, ok;
+
+    if (trace != NULL) {
+        trace->runs = 0;
+        trace->step_mismatch = 0;
+        trace->max_div = 0.0f;
+    }
+    for (v = 0; v < NUM_SIMD_VARIANTS; v++) {
+        if (simd_select(SimdVariants[v].name) != 0)
+            continue;
+        opt_kernels = SimdKernels;
+        /* the trace follows the reference path once, next to the scalar variant */
+        if (v > 0)
+            trace = NULL;
+
+        init_algo_out(&ref.out);
+        step_algo_reset(&ref);
+        init_algo_out(&opt.out);
+        step_algo_reset(&opt);
+        /* the optimised path filters with the cascaded engine */
+        if (opt.sos_filter_y.num_sect == 0) {
+            init_lp_filter(&lp_filter);
+            opt.sos_filter_y.num_sect = 1;
+            opt.sos_filter_y.coef[0][0] = lp_filter.b0;
+            opt.sos_filter_y.coef[0][1] = lp_filter.b1;
+            opt.sos_filter_y.coef[0][2] = lp_filter.b2;
+            opt.sos_filter_y.coef[0][3] = lp_filter.a1;
+            opt.sos_filter_y.coef[0][4] = lp_filter.a2;
+            reset_sos_filter(&opt.sos_filter_y);
+        }
+
+        timestamp = 0.0f;
+        max_div = 0.0f;
+        first_diff = num_samp;
+        for (pos = 0; pos < num_samp; pos += burst) {
+            burst = 1 + rand_r(&seed) % DIFF_MAX_BURST;
+            if (burst > num_samp - pos)
+                burst = num_samp - pos;
+
+            SimdKernels = opt_kernels;
+            step_algo_push(&opt, &desc, samples + pos * NUM_SENS_AXES, burst, timestamp + SENSOR_SAMP_INTVL);
+
+            SimdKernels = &SimdVariants[0];
+            for (i = pos; i < pos + burst; i++) {
+                s = samples + i * NUM_SENS_AXES;
+                timestamp += SENSOR_SAMP_INTVL;
+                if (step_algo_preproc(&ref, timestamp, s[0], s[1], s[2], s[3], s[4], s[5]) == 1) {
+                    step_algo_run(&ref);
+                    diff_trace_block(trace, &ref, SAMP_BUFF_LEN);
+                }
+            }
+            if ((diff_compare(&ref, &opt, &max_div) != 0) && (first_diff == num_samp))
+                first_diff = pos;
+        }
+        i = step_algo_finalize(&ref);
+        if (i > 0)
+            diff_trace_block(trace, &ref, i);
+        SimdKernels = opt_kernels;
+        step_algo_finalize(&opt);
+        if ((diff_compare(&ref, &opt, &max_div) != 0) && (first_diff == num_samp))
+            first_diff = num_samp - 1;
+
+        if ((first_diff == num_samp) && (max_div <= DIFF_FILTER_TOL))
+            printf("%-44s %-6s %6u steps, max filter divergence %.2e, identical\n", name, opt_kernels->name,
+                ref.out.step_count, max_div);
+        else {
+            ok = (DIFF_FAST_MATH == 1) && diff_in_bounds(ref.out.step_count, opt.out.step_count, max_div);
+            printf("%-44s %-6s %6u/%u steps, max filter divergence %.2e, first difference at sample %u, %s\n",
+                name, opt_kernels->name, ref.out.step_count, opt.out.step_count, max_div, first_diff,
+                (ok == 1) ? "within fast mode bounds" : "MISMATCH");
+            if (ok == 0)
+                failed++;
+        }
+
+        if ((trace != NULL) && (trace->write == 0)) {
+            if (trace->broken != 0) {
+                printf("%-44s %-6s trace does not match this input\n", name, "trace");
+                failed++;
+            }
+            else if ((trace->step_mismatch == 0) && (trace->max_div == 0.0f))
+                printf("%-44s %-6s %6lu runs, bit-exact\n", name, "trace", trace->runs);
+            else {
+                ok = (trace->strict == 0) && diff_in_bounds(trace->steps, ref.out.step_count, trace->max_div);
+                printf("%-44s %-6s %6u/%u steps, %lu of %lu runs differ, max filter divergence %.2e, %s\n",
+                    name, "trace", trace->steps, ref.out.step_count, trace->step_mismatch, trace->runs,
+                    trace->max_div, (ok == 1) ? "within fast mode bounds" : "MISMATCH");
+                if (ok == 0)
+                    failed++;
+            }
+        }
+    }
+    SimdKernels = selected;
+
+    return failed;
+
+}
+
+
+/* Differential check entry point
+*  Input: Arguments: [-n signals] [-s seed] [-w tracefile | -t tracefile] [inputfile ...]
+*  Output: Exit code, 1 if any optimised path (or the trace) is out of bounds
+*/
+static int run_diff(int argc, char *argv[])
+{
+    float         *samples = NULL;
+    unsigned int  num_samp, max_samp = 0;
+    unsigned int  num_signals = DIFF_NUM_SIGNALS, seed = 1, k;
+    unsigned int  hdr[3];
+    int           f, failed = 0, num_inputs = 0;
+    char          name[64];
+    diff_trace_t  trace_data, *trace = NULL;
+
+    memset(&trace_data, 0, sizeof(trace_data));
+    while ((argc >= 2) && (argv[0][0] == '-') && (argv[0][1] != '\0') && (argv[0][2] == '\0')) {
+        if (argv[0][1] == 'n')
+            num_signals = (unsigned int)atoi(argv[1]);
+        else if (argv[0][1] == 's')
+            seed = (unsigned int)atoi(argv[1]);
+        else if ((argv[0][1] == 'w') || (argv[0][1] == 't')) {
+            trace_data.write = (argv[0][1] == 'w') ? 1 : 0;
+            trace_data.fp = fopen(argv[1], (trace_data.write == 1) ? "wb" : "rb");
+            if (trace_data.fp == NULL) {
+                printf("Cannot open trace file: %s\n", argv[1]);
+                return 1;
+            }
+            trace = &trace_data;
+        }
+        else
+            break;
+        argc -= 2;
+        argv += 2;
+    }
+    if ((argc > 0) && (argv[0][0] == '-')) {
+        printf("Usage: --diff [-n signals] [-s seed] [-w tracefile | -t tracefile] [inputfile ...]\n");
+        return 1;
+    }
+    printf("Float evaluation: %s mode\n", (DIFF_FAST_MATH == 1) ? "fast" : "bit-exact");
+    if (trace != NULL) {
+        if (trace->write == 1) {
+            hdr[0] = DIFF_TRACE_MAGIC;
+            hdr[1] = DIFF_TRACE_VERSION;
+            hdr[2] = DIFF_BUILD_FLAGS;
+            fwrite(hdr, sizeof(hdr), 1, trace->fp);
+        }
+        else if ((fread(hdr, sizeof(hdr), 1, trace->fp) != 1) || (hdr[0] != DIFF_TRACE_MAGIC) ||
+                 (hdr[1] != DIFF_TRACE_VERSION)) {
+            printf("Not a trace file of this version\n");
+            return 1;
+        }
+        else {
+            trace->strict = ((hdr[2] == DIFF_BUILD_FLAGS) && (DIFF_FAST_MATH == 0)) ? 1 : 0;
+            printf("Trace of a %s mode build%s\n", ((hdr[2] & 1) != 0) ? "fast" : "bit-exact",
+                ((hdr[2] & 2) != 0) ? ", minimal RAM profile" : "");
+        }
+    }
+
+    for (f = 0; f < argc; f++) {
+        num_samp = 0;
+        if (replay_load(argv[f], &samples, &num_samp, &max_samp) != 0) {
+            printf("Cannot read input file: %s\n", argv[f]);
+            return 1;
+        }
+        failed += diff_run(argv[f], samples, num_samp, seed + f, trace);
+        num_inputs++;
+    }
+
+    for (k = 0; k < num_signals; k++) {
+        unsigned int  sig_seed = (seed * 7919 + k) * 2654435761u;
+
+        num_samp = SENSOR_SAMP_FREQ * (unsigned int)diff_rand(&sig_seed, 10.0f, 600.0f);
+        if (num_samp > max_samp) {
+            max_samp = num_samp;
+            samples = realloc(samples, max_samp * NUM_SENS_AXES * sizeof(float));
+            if (samples == NULL) {
+                printf("Out of memory\n");
+                exit(1);
+            }
+        }
+        diff_synth_signal(samples, num_samp, &sig_seed);
+        snprintf(name, sizeof(name), "synthetic %u (%u samples)", k, num_samp);
+        failed += diff_run(name, samples, num_samp, sig_seed, trace);
+        num_inputs++;
+    }
+    free(samples);
+    if (trace != NULL) {
+        /* a trace of more inputs than checked is a mismatch as well */
+        if ((trace->write == 0) && (fgetc(trace->fp) != EOF)) {
+            printf("Trace file has more inputs than checked\n");
+            failed++;
+        }
+        fclose(trace->fp);
+    }
+
+    if (failed > 0) {
+        printf("%d optimised paths out of bounds\n", failed);
+        return 1;
+    }
+    printf("All optimised paths within bounds on %d inputs\n", num_inputs);
+
+    return 0;
+
+}
+
+
+/*
+  Batch mode
+
+  Processes the recordings of a manifest (one file name per line) with a pool
+  of worker threads, every file as one stream, and prints the totals of all
+  files like main() together with the files per second. Batches of many small
+  files are dominated by the open and read system calls rather than compute:
+  the io_uring reader keeps up to queue depth files in flight (open, read and
+  close) from one thread with a system call per round instead of per
+  operation, and hands the complete files to the workers, which parse them
+  from memory. The stdio reader is the fopen/fgets path of main() in every
+  worker. Without io_uring (build or kernel) the stdio reader is used.
+
+  Reprocessing more recordings than one node can handle is split across
+  independent processes or hosts with --shard i/N: every process reads the
+  same manifest and takes the files whose name hashes to shard i, and writes
+  a summary with the results per file (-o). --merge combines the summaries of
+  all shards into the totals of the whole manifest, independent of the order
+  of the summaries (the durations are summed in file name order).
+
+  With --numa on the workers are pinned per NUMA node and their algo
+  instances are allocated on their node.
+*/
+
+#define BATCH_MAX_THREADS     ( 64 )
+#define BATCH_QUEUE_DEPTH     ( 64 )          /* files in flight of the io_uring reader */
+#define BATCH_MAX_DEPTH       ( 4096 )
+#define BATCH_READ_CHUNK      ( 256 * 1024 )  /* first read of a file, larger files are read on */
+#define BATCH_SUMMARY_MAGIC   ( 0x53444550 )  /* "PEDS" */
+#define BATCH_SUMMARY_VERSION ( 1 )
+
+/* io_uring operation in flight for a file */
+typedef enum {
+    BATCH_OP_OPEN = 0,
+    BATCH_OP_READ,
+    BATCH_OP_CLOSE
+} batch_op_t;
+
+/* One recording of the manifest, read into memory by the io_uring reader */
+typedef struct batch_file {
+    const char            *fname;
+    char                  *buf;
+    size_t                len, size;
+    int                   fd;
+    int                   err;              /* errno of the failed operation */
+    batch_op_t            op;
+    struct batch_file     *next;            /* queue of complete files */
+} batch_file_t;
+
+/* Result of one recording, a record of the shard summary */
+typedef struct {
+    char                  *fname;
+    unsigned long         samples;
+    float                 duration;         /* sec, as main() */
+    unsigned int          step_count;
+    unsigned int          type_steps[NUM_TYPES];
+    int                   err;              /* errno if the file cannot be read */
+} batch_res_t;
+
+/* Totals of one worker or one reader pass */
+typedef struct {
+    unsigned long         files, failed, samples, bytes;
+    unsigned long         steps, type_steps[NUM_TYPES];
+} batch_stats_t;
+
+/* Shared state of the reader and the workers */
+typedef struct {
+    batch_res_t           *res;             /* files of the shard */
+    unsigned int          num_files;
+    batch_file_t          *files;           /* io_uring reader */
+    int                   use_uring;
+    atomic_uint           next;             /* next file of the stdio reader */
+    pthread_mutex_t       lock;             /* queue of complete files of the io_uring reader */
+    pthread_cond_t        cond;
+    batch_file_t          *head, *tail;
+    unsigned int          queued;
+    int                   done;             /* reader finished */
+} batch_t;
+
+/* Work and totals of one worker thread */
+typedef struct {
+    batch_t               *b;
+    batch_stats_t         st;
+    step_algo_t           *algo;            /* on the node of the worker */
+    unsigned long         stream_samples;   /* samples of the current file */
+    int                   node;             /* NUMA node, -1 for the default placement */
+} batch_work_t;
+
+#if defined(STEP_ALGO_IO_URING)
+/* io_uring instance, submission and completion rings mapped from the kernel */
+typedef struct {
+    int                   fd;
+    unsigned int          entries;
+    unsigned int          *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned int          *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe   *sqes;
+    struct io_uring_cqe   *cqes;
+    void                  *sq_ptr, *cq_ptr;
+    size_t                sq_size, cq_size, sqes_size;
+} batch_ring_t;
+#endif
+
+
+/* Process one sample of a stream and account it
+*  Input: Work of the worker, timestamp in sec (updated), sensor data
+*  Output: None
+*/
+static void batch_sample(batch_work_t *w, float *timestamp, const sens_data_t *sens_data)
+{
+    *timestamp += SENSOR_SAMP_INTVL;
+    if (step_algo_preproc(w->algo, *timestamp, sens_data->arx, sens_data->ary, sens_data->arz,
+                          sens_data->grx, sens_data->gry, sens_data->grz) == 1)
+        step_algo_run(w->algo);
+    w->stream_samples++;
+    w->st.samples++;
+
+}
+
+
+/* Save the result of a finished stream and add it to the totals of the worker
+*  Input: Work of the worker, result of the file, timestamp of the last sample
+*  Output: None
+*/
+static void batch_stream_done(batch_work_t *w, batch_res_t *res, float timestamp)
+{
+    unsigned int  k;
+
+    step_algo_finalize(w->algo);
+    res->duration = timestamp;
+    res->samples = w->stream_samples;
+    res->step_count = w->algo->out.step_count;
+    res->err = 0;
+    w->st.steps += w->algo->out.step_count;
+    for (k = 0; k < NUM_TYPES; k++) {
+        res->type_steps[k] = w->algo->out.type_steps[k];
+        w->st.type_steps[k] += w->algo->out.type_steps[k];
+    }
+    w->st.files++;
+
+}
+
+
+/* Process a recording with the fopen/fgets path of main()
+*  Input: Work of the worker, result of the file (file name set)
+*  Output: 0 on success, -1 if the file cannot be read (err set)
+*/
+static int batch_run_stdio(batch_work_t *w, batch_res_t *res)
+{
+    FILE          *fpin;
+    sens_data_t   sens_data;
+    float         timestamp = 0.0f;
+
+    fpin = fopen(res->fname, "r");
+    if (fpin == NULL) {
+        res->err = errno;
+        return -1;
+    }
+    if (skip_header(fpin) != 0) {
+        res->err = EINVAL;
+        fclose(fpin);
+        return -1;
+    }
+    init_algo_out(&w->algo->out);
+    step_algo_reset(w->algo);
+    w->stream_samples = 0;
+    while (read_sens_data(fpin, &sens_data) == 0)
+        batch_sample(w, &timestamp, &sens_data);
+    w->st.bytes += (unsigned long)ftell(fpin);
+    fclose(fpin);
+    batch_stream_done(w, res, timestamp);
+
+    return 0;
+
+}
+
+
+/* Process a recording read into memory, line by line like fgets
+*  Input: Work of the worker, result of the file, file data, length
+*  Output: 0 on success, -1 if the file is too short (err set)
+*/
+static int batch_run_mem(batch_work_t *w, batch_res_t *res, const char *buf, size_t len)
+{
+    char          line_buff[MAX_CHAR_PER_LINE];
+    sens_data_t   sens_data;
+    const char    *end = buf + len, *eol;
+    size_t        n;
+    float         timestamp = 0.0f;
+    unsigned int  skip_lines = 2;
+
+    init_algo_out(&w->algo->out);
+    step_algo_reset(w->algo);
+    w->stream_samples = 0;
+    while (buf < end) {
+        /* one line of at most MAX_CHAR_PER_LINE - 1 characters, as fgets */
+        n = end - buf;
+        if (n > MAX_CHAR_PER_LINE - 1)
+            n = MAX_CHAR_PER_LINE - 1;
+        eol = memchr(buf, '\n', n);
+        if (eol != NULL)
+            n = eol - buf + 1;
+        memcpy(line_buff, buf, n);
+        line_buff[n] = '\0';
+        buf += n;
+
+        if (skip_lines > 0)
+            skip_lines--;
+        else {
+            parse_sens_data(line_buff, &sens_data);
+            batch_sample(w, &timestamp, &sens_data);
+        }
+    }
+    if (skip_lines > 0) {
+        res->err = EINVAL;
+        return -1;
+    }
+    w->st.bytes += len;
+    batch_stream_done(w, res, timestamp);
+
+    return 0;
+
+}
+
+
+/* Worker thread, processes files of the manifest (stdio reader) or the
+*  complete files queued by the io_uring reader
+*  Input: Work of the worker
+*  Output: NULL
+*/
+static void *batch_worker(void *arg)
+{
+    batch_work_t  *w = (batch_work_t *)arg;
+    batch_t       *b = w->b;
+    batch_file_t  *file;
+    batch_res_t   *res;
+    unsigned int  f;
+
+    numa_pin(w->node);
+    while (b->use_uring == 0) {
+        f = atomic_fetch_add(&b->next, 1);
+        if (f >= b->num_files)
+            return NULL;
+        if (batch_run_stdio(w, &b->res[f]) != 0) {
+            printf("Cannot read input file: %s (%s)\n", b->res[f].fname, strerror(b->res[f].err));
+            w->st.failed++;
+        }
+    }
+
+    while (1) {
+        pthread_mutex_lock(&b->lock);
+        while ((b->head == NULL) && (b->done == 0))
+            pthread_cond_wait(&b->cond, &b->lock);
+        file = b->head;
+        if (file == NULL) {
+            pthread_mutex_unlock(&b->lock);
+            return NULL;
+        }
+        b->head = file->next;
+        b->queued--;
+        /* the reader waits for free buffers */
+        pthread_cond_broadcast(&b->cond);
+        pthread_mutex_unlock(&b->lock);
+
+        res = &b->res[file - b->files];
+        res->err = file->err;
+        if ((res->err != 0) || (batch_run_mem(w, res, file->buf, file->len) != 0)) {
+            printf("Cannot read input file: %s (%s)\n", res->fname, strerror(res->err));
+            w->st.failed++;
+        }
+        free(file->buf);
+        file->buf = NULL;
+    }
+
+}
+
+
+#if defined(STEP_ALGO_IO_URING)
+/* Set up an io_uring instance and map its rings
+*  Input: Ring, number of entries
+*  Output: 0 on success, -1 if io_uring is not available (errno set)
+*/
+static int batch_ring_init(batch_ring_t *ring, unsigned int entries)
+{
+    static const unsigned int  ops[] = { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE };
+    struct io_uring_params  p;
+    struct io_uring_probe   *probe;
+    unsigned int            k, supported = 1;
+
+    memset(&p, 0, sizeof(p));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0)
+        return -1;
+    ring->entries = p.sq_entries;
+
+    /* Kernels before 5.6 have io_uring without open, read and close (and */
+    /* without the probe), the reader needs all three                     */
+    probe = calloc(1, sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op));
+    if (probe == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+        supported = 0;
+    for (k = 0; (supported == 1) && (k < sizeof(ops) / sizeof(ops[0])); k++) {
+        if ((ops[k] > probe->last_op) || ((probe->ops[ops[k]].flags & IO_URING_OP_SUPPORTED) == 0))
+            supported = 0;
+    }
+    free(probe);
+    if (supported == 0) {
+        close(ring->fd);
+        errno = ENOSYS;
+        return -1;
+    }
+
+    ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if ((ring->sq_ptr == MAP_FAILED) || (ring->cq_ptr == MAP_FAILED) || (ring->sqes == MAP_FAILED)) {
+        close(ring->fd);
+        return -1;
+    }
+
+    ring->sq_head = (unsigned int *)((char *)ring->sq_ptr + p.sq_off.head);
+    ring->sq_tail = (unsigned int *)((char *)ring->sq_ptr + p.sq_off.tail);
+    ring->sq_mask = (unsigned int *)((char *)ring->sq_ptr + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *)((char *)ring->sq_ptr + p.sq_off.array);
+    ring->cq_head = (unsigned int *)((char *)ring->cq_ptr + p.cq_off.head);
+    ring->cq_tail = (unsigned int *)((char *)ring->cq_ptr + p.cq_off.tail);
+    ring->cq_mask = (unsigned int *)((char *)ring->cq_ptr + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr + p.cq_off.cqes);
+
+    return 0;
+
+}
+
+
+/* Unmap the rings and close an io_uring instance
+*  Input: Ring
+*  Output: None
+*/
+static void batch_ring_free(batch_ring_t *ring)
+{
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->cq_ptr, ring->cq_size);
+    munmap(ring->sq_ptr, ring->sq_size);
+    close(ring->fd);
+
+}
+
+
+/* Queue the next operation of a file, submitted with the next batch_ring_enter.
+*  The reader keeps at most one operation per file and at most ring entries
+*  files in flight, so the submission ring never overflows.
+*  Input: Ring, file (op, fd, buf, len and size set)
+*  Output: None
+*/
+static void batch_ring_queue(batch_ring_t *ring, batch_file_t *file)
+{
+    unsigned int  tail = *ring->sq_tail;
+    unsigned int  idx = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    if (file->op == BATCH_OP_OPEN) {
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (unsigned long)file->fname;
+        sqe->open_flags = O_RDONLY;
+    }
+    else if (file->op == BATCH_OP_READ) {
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = file->fd;
+        sqe->addr = (unsigned long)(file->buf + file->len);
+        sqe->len = (unsigned int)(file->size - file->len);
+        sqe->off = file->len;
+    }
+    else {
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = file->fd;
+    }
+    sqe->user_data = (unsigned long)file;
+    ring->sq_array[idx] = idx;
+    /* publish the entry after it is written */
+    atomic_store_explicit((atomic_uint *)ring->sq_tail, tail + 1, memory_order_release);
+
+}
+
+
+/* Submit the queued operations and wait for completions
+*  Input: Ring, number of queued operations, min number of completions
+*  Output: 0 on success, -1 on error
+*/
+static int batch_ring_enter(batch_ring_t *ring, unsigned int to_submit, unsigned int min_complete)
+{
+    long          ret;
+
+    do {
+        ret = syscall(__NR_io_uring_enter, ring->fd, to_submit, min_complete,
+                      (min_complete > 0) ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while ((ret < 0) && (errno == EINTR));
+
+    return (ret < 0) ? -1 : 0;
+
+}
+
+
+/* Hand a complete (or failed) file to the workers
+*  Input: Batch, file
+*  Output: None
+*/
+static void batch_enqueue(batch_t *b, batch_file_t *file)
+{
+    pthread_mutex_lock(&b->lock);
+    file->next = NULL;
+    if (b->head == NULL)
+        b->head = file;
+    else
+        b->tail->next = file;
+    b->tail = file;
+    b->queued++;
+    pthread_cond_broadcast(&b->cond);
+    pthread_mutex_unlock(&b->lock);
+
+}
+
+
+/* Advance a file after the completion of its operation
+*  Input: Batch, ring, file, result of the operation
+*  Output: 1 if a new operation is queued, 0 if the file left the ring
+*/
+static int batch_complete(batch_t *b, batch_ring_t *ring, batch_file_t *file, int res)
+{
+    if (file->op == BATCH_OP_OPEN) {
+        if (res < 0) {
+            file->err = -res;
+            batch_enqueue(b, file);
+            return 0;
+        }
+        file->fd = res;
+        file->size = BATCH_READ_CHUNK;
+        file->buf = malloc(file->size);
+        if (file->buf == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+        file->op = BATCH_OP_READ;
+    }
+    else if (file->op == BATCH_OP_READ) {
+        if (res < 0)
+            file->err = -res;
+        else
+            file->len += res;
+        if ((res > 0) && (file->len == file->size)) {
+            /* buffer full, read on */
+            file->size *= 2;
+            file->buf = realloc(file->buf, file->size);
+            if (file->buf == NULL) {
+                printf("Out of memory\n");
+                exit(1);
+            }
+        }
+        else {
+            /* a short read is the end of a regular file */
+            file->op = BATCH_OP_CLOSE;
+        }
+    }
+    else {
+        batch_enqueue(b, file);
+        return 0;
+    }
+    batch_ring_queue(ring, file);
+
+    return 1;
+
+}
+
+
+/* io_uring reader, keeps up to depth files in flight and queues the complete
+*  files for the workers; the files waiting for a worker count as in flight,
+*  which bounds the memory to about depth buffers
+*  Input: Batch, ring, queue depth
+*  Output: 0 on success, -1 on an io_uring error
+*/
+static int batch_read_uring(batch_t *b, batch_ring_t *ring, unsigned int depth)
+{
+    batch_file_t  *files = b->files;
+    struct io_uring_cqe *cqe;
+    unsigned int  next = 0, in_ring = 0, to_submit = 0, head, queued;
+
+    while ((next < b->num_files) || (in_ring > 0)) {
+        pthread_mutex_lock(&b->lock);
+        while ((in_ring == 0) && (b->queued >= depth))
+            pthread_cond_wait(&b->cond, &b->lock);
+        queued = b->queued;
+        pthread_mutex_unlock(&b->lock);
+
+        while ((next < b->num_files) && (in_ring + queued < depth)) {
+            files[next].fname = b->res[next].fname;
+            files[next].op = BATCH_OP_OPEN;
+            batch_ring_queue(ring, &files[next]);
+            next++;
+            in_ring++;
+            to_submit++;
+        }
+        if (batch_ring_enter(ring, to_submit, (in_ring > 0) ? 1 : 0) != 0)
+            return -1;
+        to_submit = 0;
+
+        /* reap all completions */
+        head = *ring->cq_head;
+        while (head != atomic_load_explicit((atomic_uint *)ring->cq_tail, memory_order_acquire)) {
+            cqe = &ring->cqes[head & *ring->cq_mask];
+            if (batch_complete(b, ring, (batch_file_t *)(unsigned long)cqe->user_data, cqe->res) == 1)
+                to_submit++;
+            else
+                in_ring--;
+            head++;
+        }
+        atomic_store_explicit((atomic_uint *)ring->cq_head, head, memory_order_release);
+        if ((to_submit > 0) && (batch_ring_enter(ring, to_submit, 0) != 0))
+            return -1;
+        to_submit = 0;
+    }
+
+    return 0;
+
+}
+#endif
+
+
+/* Process all files of the manifest with one reader
+*  Input: Batch (use_uring set), number of worker threads, queue depth,
+*         totals (output)
+*  Output: Wall time in sec, negative if the reader failed
+*/
+static double batch_pass(batch_t *b, unsigned int num_threads, unsigned int depth, batch_stats_t *st)
+{
+    static batch_work_t  work[BATCH_MAX_THREADS];
+    pthread_t     threads[BATCH_MAX_THREADS];
+    unsigned int  t, k;
+    double        t_start, t_wall;
+    int           failed = 0;
+#if defined(STEP_ALGO_IO_URING)
+    batch_ring_t  ring;
+
+    if (b->use_uring == 1) {
+        if (batch_ring_init(&ring, depth) != 0)
+            return -1.0;
+        b->files = calloc(b->num_files, sizeof(batch_file_t));
+        if (b->files == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+    }
+#endif
+
+    atomic_init(&b->next, 0);
+    b->head = b->tail = NULL;
+    b->queued = 0;
+    b->done = 0;
+    t_start = get_time_sec();
+    for (t = 0; t < num_threads; t++) {
+        memset(&work[t].st, 0, sizeof(work[t].st));
+        work[t].b = b;
+        work[t].node = numa_worker_node(t);
+        work[t].algo = numa_alloc(sizeof(step_algo_t), work[t].node);
+        if (work[t].algo == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+        if (pthread_create(&threads[t], NULL, batch_worker, &work[t]) != 0) {
+            printf("Cannot create worker thread\n");
+            exit(1);
+        }
+    }
+#if defined(STEP_ALGO_IO_URING)
+    if (b->use_uring == 1) {
+        failed = batch_read_uring(b, &ring, depth);
+        pthread_mutex_lock(&b->lock);
+        b->done = 1;
+        pthread_cond_broadcast(&b->cond);
+        pthread_mutex_unlock(&b->lock);
+    }
+#endif
+    for (t = 0; t < num_threads; t++)
+        pthread_join(threads[t], NULL);
+    t_wall = get_time_sec() - t_start;
+    for (t = 0; t < num_threads; t++)
+        numa_free(work[t].algo, sizeof(step_algo_t));
+#if defined(STEP_ALGO_IO_URING)
+    if (b->use_uring == 1) {
+        batch_ring_free(&ring);
+        free(b->files);
+        b->files = NULL;
+    }
+#endif
+
+    memset(st, 0, sizeof(*st));
+    for (t = 0; t < num_threads; t++) {
+        st->files += work[t].st.files;
+        st->failed += work[t].st.failed;
+        st->samples += work[t].st.samples;
+        st->bytes += work[t].st.bytes;
+        st->steps += work[t].st.steps;
+        for (k = 0; k < NUM_TYPES; k++)
+            st->type_steps[k] += work[t].st.type_steps[k];
+    }
+
+    return (failed != 0) ? -1.0 : t_wall;
+
+}
+
+
+/* Shard of a recording, FNV-1a hash of the file name as listed in the
+*  manifest, the same on every host and independent of the manifest order
+*  Input: File name, number of shards
+*  Output: Shard 0..num_shards-1
+*/
+static unsigned int batch_shard_of(const char *fname, unsigned int num_shards)
+{
+    unsigned int  h = 2166136261u;
+
+    while (*fname != '\0')
+        h = (h ^ (unsigned char)*fname++) * 16777619u;
+
+    return h % num_shards;
+
+}
+
+
+/* Compare the file names of two results, for qsort
+*  Input: Results
+*  Output: strcmp of the file names
+*/
+static int batch_cmp_res(const void *a, const void *b)
+{
+    return strcmp(((const batch_res_t *)a)->fname, ((const batch_res_t *)b)->fname);
+
+}
+
+
+/* Print the totals of a list of results like main() does for one file. The
+*  results are sorted by file name first, so the float sum of the durations
+*  does not depend on the order of the files or summaries.
+*  Input: Results, number of results
+*  Output: Number of files that could not be read
+*/
+static unsigned long batch_print_totals(batch_res_t *res, unsigned int num_res)
+{
+    algo_out_t    total;
+    double        duration = 0.0;
+    unsigned long type_steps[NUM_TYPES] = { 0 }, steps = 0, failed = 0;
+    unsigned int  f, k;
+
+    qsort(res, num_res, sizeof(batch_res_t), batch_cmp_res);
+    for (f = 0; f < num_res; f++) {
+        if (res[f].err != 0) {
+            failed++;
+            continue;
+        }
+        duration += res[f].duration;
+        steps += res[f].step_count;
+        for (k = 0; k < NUM_TYPES; k++)
+            type_steps[k] += res[f].type_steps[k];
+    }
+
+    init_algo_out(&total);
+    total.step_count = (unsigned int)steps;
+    for (k = 0; k < NUM_TYPES; k++)
+        total.type_steps[k] = (unsigned int)type_steps[k];
+    printf("%u files, %lu could not be read\n", num_res, failed);
+    print_summary((float)duration, &total);
+
+    return failed;
+
+}
+
+
+/* Write the summary of a shard: header (magic, version, shard, number of
+*  shards, number of files) and per file the name length, name, error, samples,
+*  duration, step_count and steps per type, native byte order
+*  Input: Summary file name, results, number of results, shard, number of shards
+*  Output: 0 on success, -1 on a write error
+*/
+static int batch_write_summary(const char *fname, const batch_res_t *res, unsigned int num_res,
+                               unsigned int shard, unsigned int num_shards)
+{
+    FILE          *fp;
+    unsigned int  hdr[5] = { BATCH_SUMMARY_MAGIC, BATCH_SUMMARY_VERSION, shard, num_shards, num_res };
+    unsigned int  f, len;
+    int           err = 0;
+
+    fp = fopen(fname, "wb");
+    if (fp == NULL)
+        return -1;
+    fwrite(hdr, sizeof(hdr), 1, fp);
+    for (f = 0; f < num_res; f++) {
+        len = (unsigned int)strlen(res[f].fname);
+        fwrite(&len, sizeof(len), 1, fp);
+        fwrite(res[f].fname, 1, len, fp);
+        fwrite(&res[f].err, sizeof(res[f].err), 1, fp);
+        fwrite(&res[f].samples, sizeof(res[f].samples), 1, fp);
+        fwrite(&res[f].duration, sizeof(res[f].duration), 1, fp);
+        fwrite(&res[f].step_count, sizeof(res[f].step_count), 1, fp);
+        fwrite(res[f].type_steps, sizeof(res[f].type_steps), 1, fp);
+    }
+    if (ferror(fp))
+        err = -1;
+    if (fclose(fp) != 0)
+        err = -1;
+
+    return err;
+
+}
+
+
+/* Read the summary of a shard and append its results
+*  Input: Summary file name, results (grown), number of results (updated),
+*         max results (updated), shard and number of shards (output)
+*  Output: 0 on success, -1 if the file is not a summary of this version
+*/
+static int batch_read_summary(const char *fname, batch_res_t **res, unsigned int *num_res, unsigned int *max_res,
+                              unsigned int *shard, unsigned int *num_shards)
+{
+    FILE          *fp;
+    unsigned int  hdr[5], f, len;
+    batch_res_t   *r;
+    int           err = 0;
+
+    fp = fopen(fname, "rb");
+    if (fp == NULL)
+        return -1;
+    if ((fread(hdr, sizeof(hdr), 1, fp) != 1) || (hdr[0] != BATCH_SUMMARY_MAGIC) ||
+        (hdr[1] != BATCH_SUMMARY_VERSION) || (hdr[3] == 0) || (hdr[2] >= hdr[3])) {
+        fclose(fp);
+        return -1;
+    }
+    *shard = hdr[2];
+    *num_shards = hdr[3];
+    for (f = 0; (f < hdr[4]) && (err == 0); f++) {
+        if (*num_res == *max_res) {
+            *max_res = (*max_res == 0) ? 1024 : 2 * *max_res;
+            *res = realloc(*res, *max_res * sizeof(batch_res_t));
+            if (*res == NULL) {
+                printf("Out of memory\n");
+                exit(1);
+            }
+        }
+        r = &(*res)[*num_res];
+        if ((fread(&len, sizeof(len), 1, fp) != 1) || (len >= FILENAME_MAX) ||
+            ((r->fname = malloc(len + 1)) == NULL)) {
+            err = -1;
+            break;
+        }
+        r->fname[len] = '\0';
+        if ((fread(r->fname, 1, len, fp) != len) ||
+            (fread(&r->err, sizeof(r->err), 1, fp) != 1) ||
+            (fread(&r->samples, sizeof(r->samples), 1, fp) != 1) ||
+            (fread(&r->duration, sizeof(r->duration), 1, fp) != 1) ||
+            (fread(&r->step_count, sizeof(r->step_count), 1, fp) != 1) ||
+            (fread(r->type_steps, sizeof(r->type_steps), 1, fp) != 1) ||
+            (batch_shard_of(r->fname, *num_shards) != *shard)) {
+            free(r->fname);
+            err = -1;
+            break;
+        }
+        (*num_res)++;
+    }
+    if ((err == 0) && (fgetc(fp) != EOF))
+        err = -1;
+    fclose(fp);
+
+    return err;
+
+}
+
+
+/* Batch mode entry point
+*  Input: Arguments: [-j threads] [-q depth] [-r uring|stdio|both] [--shard i/N]
+*         [-o summaryfile] manifestfile
+*  Output: Exit code
+*/
+static int run_batch(int argc, char *argv[])
+{
+    FILE          *fpman;
+    char          line_buff[FILENAME_MAX];
+    const char    *reader = NULL, *summary = NULL;
+    unsigned int  num_threads = 0, depth = BATCH_QUEUE_DEPTH, max_files = 0, r;
+    unsigned int  shard = 0, num_shards = 1, num_listed = 0;
+    size_t        n;
+    batch_t       b;
+    batch_stats_t st, prev_st;
+    double        t_wall, rate[2] = { 0.0, 0.0 };
+    unsigned long failed;
+
+    memset(&b, 0, sizeof(b));
+    while ((argc >= 2) && (argv[0][0] == '-')) {
+        if (strcmp(argv[0], "-j") == 0)
+            num_threads = (unsigned int)atoi(argv[1]);
+        else if (strcmp(argv[0], "-q") == 0)
+            depth = (unsigned int)atoi(argv[1]);
+        else if (strcmp(argv[0], "-r") == 0)
+            reader = argv[1];
+        else if (strcmp(argv[0], "-o") == 0)
+            summary = argv[1];
+        else if (strcmp(argv[0], "--shard") == 0) {
+            if ((sscanf(argv[1], "%u/%u", &shard, &num_shards) != 2) || (num_shards == 0) || (shard >= num_shards)) {
+                printf("Invalid shard: %s (i/N, 0 <= i < N)\n", argv[1]);
+                return 1;
+            }
+        }
+        else
+            break;
+        argc -= 2;
+        argv += 2;
+    }
+    /* a summary needs one pass only */
+    if (reader == NULL)
+        reader = (summary != NULL) ? "uring" : "both";
+    if ((argc != 1) || (depth == 0) || (depth > BATCH_MAX_DEPTH) ||
+        ((strcmp(reader, "uring") != 0) && (strcmp(reader, "stdio") != 0) && (strcmp(reader, "both") != 0))) {
+        printf("Usage: --batch [-j threads] [-q depth] [-r uring|stdio|both] [--shard i/N] [-o summaryfile] manifestfile\n");
+        return 1;
+    }
+    /* Workers would interleave their records in the one feature file */
+    if (FeatFile != NULL) {
+        printf("--features is not supported with --batch, export the features of one recording at a time\n");
+        return 1;
+    }
+    if (num_threads == 0) {
+        long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = (num_cpus > 0) ? (unsigned int)num_cpus : 1;
+    }
+    if (num_threads > BATCH_MAX_THREADS)
+        num_threads = BATCH_MAX_THREADS;
+
+    /* One recording per line, empty lines and lines starting with '#' are ignored */
+    fpman = fopen(argv[0], "r");
+    if (fpman == NULL) {
+        printf("Cannot open manifest file: %s\n", argv[0]);
+        return 1;
+    }
+    while (NULL != fgets(line_buff, sizeof(line_buff), fpman)) {
+        n = strcspn(line_buff, "\r\n");
+        line_buff[n] = '\0';
+        if ((n == 0) || (line_buff[0] == '#'))
+            continue;
+        num_listed++;
+        if (batch_shard_of(line_buff, num_shards) != shard)
+            continue;
+        if (b.num_files == max_files) {
+            max_files = (max_files == 0) ? 1024 : 2 * max_files;
+            b.res = realloc(b.res, max_files * sizeof(batch_res_t));
+        }
+        if (b.res == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+        memset(&b.res[b.num_files], 0, sizeof(batch_res_t));
+        if ((b.res[b.num_files++].fname = strdup(line_buff)) == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+    }
+    fclose(fpman);
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_cond_init(&b.cond, NULL);
+
+    if (num_shards > 1)
+        printf("Shard %u/%u: %u of %u files\n", shard, num_shards, b.num_files, num_listed);
+    printf("%u files, %u worker threads, queue depth %u\n", b.num_files, num_threads, depth);
+    for (r = 0; r < 2; r++) {
+        b.use_uring = (int)r;
+        if (strcmp(reader, (r == 0) ? "uring" : "stdio") == 0)
+            continue;
+#if !defined(STEP_ALGO_IO_URING)
+        if (r == 1) {
+            printf("io_uring reader not available in this build, using the stdio reader\n");
+            b.use_uring = 0;
+        }
+#endif
+        t_wall = batch_pass(&b, num_threads, depth, &st);
+        if ((t_wall < 0.0) && (r == 1)) {
+            printf("io_uring reader not available (%s), using the stdio reader\n", strerror(errno));
+            b.use_uring = 0;
+            t_wall = batch_pass(&b, num_threads, depth, &st);
+        }
+        rate[r] = st.files / t_wall;
+        printf("%-5s reader: %lu files (%lu failed), %.3f sec, %.0f files/sec, %.1f MB/sec, %.1f M samples/sec\n",
+            (b.use_uring == 1) ? "uring" : "stdio", st.files, st.failed, t_wall, rate[r],
+            st.bytes / t_wall * 1E-6, st.samples / t_wall * 1E-6);
+        if ((r == 1) && (rate[0] > 0.0) && (memcmp(&st, &prev_st, sizeof(st)) != 0))
+            printf("Totals of the readers differ\n");
+        prev_st = st;
+    }
+    if ((rate[0] > 0.0) && (rate[1] > 0.0) && (b.use_uring == 1))
+        printf("io_uring reader: %.2fx the files/sec of the stdio reader\n", rate[1] / rate[0]);
+
+    if ((summary != NULL) && (batch_write_summary(summary, b.res, b.num_files, shard, num_shards) != 0)) {
+        printf("Cannot write summary file: %s\n", summary);
+        return 1;
+    }
+    failed = batch_print_totals(b.res, b.num_files);
+    printf("Done.\n");
+
+    for (r = 0; r < b.num_files; r++)
+        free(b.res[r].fname);
+    free(b.res);
+
+    return (failed > 0) ? 1 : 0;
+
+}
+
+
+/* Merge mode entry point, combines the summaries of all shards of a batch
+*  into the totals of the whole manifest
+*  Input: Arguments: summaryfile [summaryfile ...]
+*  Output: Exit code, 1 if a summary is invalid, a shard is missing or twice
+*/
+static int run_merge(int argc, char *argv[])
+{
+    batch_res_t   *res = NULL;
+    unsigned int  num_res = 0, max_res = 0, shard, num_shards, total_shards = 0, f;
+    unsigned char *seen = NULL;
+    int           err = 0;
+    unsigned long failed;
+
+    if (argc < 1) {
+        printf("Usage: --merge summaryfile [summaryfile ...]\n");
+        return 1;
+    }
+    for (f = 0; f < (unsigned int)argc; f++) {
+        if (batch_read_summary(argv[f], &res, &num_res, &max_res, &shard, &num_shards) != 0) {
+            printf("Not a valid summary file of this version: %s\n", argv[f]);
+            return 1;
+        }
+        if (total_shards == 0) {
+            total_shards = num_shards;
+            seen = calloc(total_shards, 1);
+            if (seen == NULL) {
+                printf("Out of memory\n");
+                exit(1);
+            }
+        }
+        if (num_shards != total_shards) {
+            printf("Summary of a batch of %u shards, not %u: %s\n", num_shards, total_shards, argv[f]);
+            return 1;
+        }
+        if (seen[shard]++ > 0) {
+            printf("Shard %u/%u merged twice: %s\n", shard, num_shards, argv[f]);
+            err = 1;
+        }
+    }
+    for (shard = 0; shard < total_shards; shard++) {
+        if (seen[shard] == 0) {
+            printf("Shard %u/%u is missing\n", shard, total_shards);
+            err = 1;
+        }
+    }
+
+    printf("Merged %d summaries of %u shards\n", argc, total_shards);
+    failed = batch_print_totals(res, num_res);
+    printf("Done.\n");
+
+    for (f = 0; f < num_res; f++)
+        free(res[f].fname);
+    free(res);
+    free(seen);
+
+    return ((err != 0) || (failed > 0)) ? 1 : 0;
+
+}
+
+
+/*
+  Library interface
+
+  Entry points for in-process callers, e.g. the Python bindings (pedometer.py).
+  Build the shared library with
+    gcc -Wall -O2 -shared -fPIC -o libpedometer.so pedometer.c -lm -pthread
+  Every context (step_algo_ctx_t) is an independent stream with its own
+  filters, buffers and step totals, so contexts can be processed concurrently
+  from different threads. The preprocessing options (step_algo_configure) are
+  shared by all contexts, set them before creating any. The feature vector of
+  every algo run (the block features of --features) can be collected per
+  context with step_algo_feat_output.
+*/
+
+/* Set the preprocessing options of all contexts, the library equivalent of
+*  --simd, --filter, --magnitude and --gyro
+*  Input: SIMD kernels (NULL or "auto" for the best the CPU supports), filter
+*         (NULL for the default, else lp:order:fc or bp:order:f1:f2), use the
+*         magnitude channel, validate steps with the gyro (not available in the
+*         minimal RAM profile)
+*  Output: 0 on success, -1 on an invalid or unavailable option
+*/
+int step_algo_configure(const char *simd, const char *filter, int magnitude, int gyro)
+{
+    sos_filter_t  sos_filter;
+
+    if (simd_select((simd != NULL) ? simd : "auto") != 0)
+        return -1;
+    memset(&sos_filter, 0, sizeof(sos_filter));
+    if ((filter != NULL) && (parse_filter_opt(filter, &sos_filter) != 0))
+        return -1;
+#if defined(STEP_ALGO_MIN_RAM)
+    if ((magnitude != 0) || (gyro != 0))
+        return -1;
+#else
+    InputMode = (magnitude != 0) ? INPUT_ACC_MAG : INPUT_ACC_Y;
+    GyroValidate = (gyro != 0) ? 1 : 0;
+#endif
+    SosFilterY = sos_filter;
+
+    return 0;
+
+}
+
+
+/* Create a context for one sensor stream
+*  Input: None
+*  Output: Context, NULL if out of memory
+*/
+step_algo_ctx_t *step_algo_create(void)
+{
+    step_algo_ctx_t *ctx = calloc(1, sizeof(step_algo_ctx_t));
+
+    if (ctx != NULL)
+        step_algo_ctx_reset(ctx);
+
+    return ctx;
+
+}
+
+
+/* Destroy a context
+*  Input: Context (or NULL)
+*  Output: None
+*/
+void step_algo_destroy(step_algo_ctx_t *ctx)
+{
+    free(ctx);
+
+}
+
+
+/* Start a new stream on a context, the step totals are cleared
+*  Input: Context
+*  Output: None
+*/
+void step_algo_ctx_reset(step_algo_ctx_t *ctx)
+{
+    init_algo_out(&ctx->algo.out);
+    step_algo_reset(&ctx->algo);
+    ctx->timestamp = 0.0f;
+    ctx->num_samp = 0;
+
+}
+
+
+/* Steps of one motion type (STATIC..RUN) or all steps (NUM_TYPES) so far
+*  Input: Context, motion type
+*  Output: Number of steps
+*/
+unsigned int step_algo_steps(const step_algo_ctx_t *ctx, unsigned int type)
+{
+    if (type >= NUM_TYPES)
+        return ctx->algo.out.step_count;
+
+    return ctx->algo.out.type_steps[type];
+
+}
+
+
+#if !defined(STEP_ALGO_MIN_RAM)
+/* Feature sink of a context, appends to the block feature output
+*  Input: Context, block features
+*  Output: None
+*/
+static void lib_feat_sink(void *arg, const block_feat_t *feat)
+{
+    step_algo_ctx_t *ctx = (step_algo_ctx_t *)arg;
+
+    if (ctx->num_feat < ctx->max_feat)
+        ctx->feat[ctx->num_feat] = *feat;
+    ctx->num_feat++;
+
+}
+#endif
+
+
+/* Set the block feature output of a context: the feature vector of every
+*  following algo run of the stream is written to feat (one per block of
+*  step_algo_feat_layout, the trailing one of a finalize included)
+*  Input: Context, feature array (NULL to stop collecting), its length
+*  Output: 0 on success, -1 in the minimal RAM profile (no features)
+*/
+int step_algo_feat_output(step_algo_ctx_t *ctx, block_feat_t *feat, unsigned int max_feat)
+{
+#if defined(STEP_ALGO_MIN_RAM)
+    (void)ctx;
+    (void)feat;
+    (void)max_feat;
+    return -1;
+#else
+    ctx->feat = feat;
+    ctx->max_feat = (feat != NULL) ? max_feat : 0;
+    ctx->num_feat = 0;
+    ctx->algo.feat_sink = (feat != NULL) ? lib_feat_sink : NULL;
+    ctx->algo.feat_arg = ctx;
+
+    return 0;
+#endif
+
+}
+
+
+/* Block features collected since step_algo_feat_output
+*  Input: Context
+*  Output: Number of algo runs, only the first max_feat are written
+*/
+unsigned int step_algo_num_feat(const step_algo_ctx_t *ctx)
+{
+    return ctx->num_feat;
+
+}
+
+
+/* Layout of the block features for bindings
+*  Input: Samples per block (algo run, output), spectral bins per axis (output)
+*  Output: Bytes of one block_feat_t, 0 in the minimal RAM profile
+*/
+unsigned int step_algo_feat_layout(unsigned int *block_len, unsigned int *num_spec_bins)
+{
+    *block_len = SAMP_BUFF_LEN;
+    *num_spec_bins = NUM_SPEC_BINS;
+#if defined(STEP_ALGO_MIN_RAM)
+    return 0;
+#else
+    return sizeof(block_feat_t);
+#endif
+
+}
+
+
+/* Collect the step events of the algo run just done at the step min samples
+*  of the stream; steps beyond the MAX_BLOCK_STEPS samples kept by an algo
+*  run are reported at the last sample of the run.
+*  Input: Context, step_count before the run, index of the last sample of the
+*         run, event arrays, their length, number of events so far (updated)
+*  Output: None
+*/
+static void lib_collect_events(const step_algo_ctx_t *ctx, unsigned int prev_count, long last,
+                               unsigned int *event_samp, unsigned int *event_type, unsigned int max_events,
+                               unsigned int *num_events)
+{
+    const algo_out_t  *out = &ctx->algo.out;
+    unsigned int  j, num_ts = out->num_block_steps;
+    long          idx;
+
+    if (num_ts > MAX_BLOCK_STEPS)
+        num_ts = MAX_BLOCK_STEPS;
+    for (j = 0; j < out->step_count - prev_count; j++) {
+        idx = (j < num_ts) ? (long)out->block_step_samp[j] : last;
+        if ((idx < 0) || (idx > last))
+            idx = last;
+        if ((event_samp != NULL) && (*num_events < max_events)) {
+            event_samp[*num_events] = (unsigned int)idx;
+            event_type[*num_events] = (unsigned int)out->step_type;
+        }
+        (*num_events)++;
+    }
+
+}
+
+
+/* Process an array of samples of the stream, the same as the per row loop of
+*  main() followed by step_algo_finalize if the stream ends with the array.
+*  Input: Context, samples (AccY only if num_axes is 1, else interleaved AccX,
+*         AccY, AccZ and, if num_axes is 6, GyroX, GyroY, GyroZ), num_axes,
+*         number of samples, per sample step_count output (or NULL; after
+*         finalize the last sample has the final count), step event outputs:
+*         sample index within the stream (see step_algo_steps for the totals)
+*         and motion type (or NULL), length of the event outputs, finalize
+*  Output: Number of step events, only the first max_events are written
+*/
+unsigned int step_algo_process(step_algo_ctx_t *ctx, const float *samples, unsigned int num_axes,
+                               unsigned int num_samp, unsigned int *step_count,
+                               unsigned int *event_samp, unsigned int *event_type, unsigned int max_events,
+                               int finalize)
+{
+    const fifo_desc_t  desc = { FIFO_FLOAT, num_axes, 1.0f, 1.0f };
+    const float   *axes[NUM_SENS_AXES] = { NULL };
+    step_algo_t   *algo = &ctx->algo;
+    unsigned int  prev_count, pos, len, i, num_events = 0;
+
+    for (pos = 0; pos < num_samp; pos += len) {
+        /* up to the end of the sensor input buffer, at most one algo run */
+        len = SAMP_BUFF_LEN - algo->AccBuffCount;
+        if (len > num_samp - pos)
+            len = num_samp - pos;
+        prev_count = algo->out.step_count;
+
+        if (num_axes == 1) {
+            axes[CHY] = samples + pos;
+            step_algo_push_arrays(algo, axes, NULL, len, ctx->timestamp + SENSOR_SAMP_INTVL);
+        }
+        else
+            step_algo_push(algo, &desc, samples + pos * num_axes, len, ctx->timestamp + SENSOR_SAMP_INTVL);
+        for (i = 0; i < len; i++)
+            ctx->timestamp += SENSOR_SAMP_INTVL;
+
+        ctx->num_samp += len;
+        if (step_count != NULL) {
+            for (i = pos; i < pos + len - 1; i++)
+                step_count[i] = prev_count;
+            step_count[pos + len - 1] = algo->out.step_count;
+        }
+        lib_collect_events(ctx, prev_count, (long)ctx->num_samp - 1, event_samp, event_type, max_events, &num_events);
+    }
+
+    if (finalize != 0) {
+        prev_count = algo->out.step_count;
+        if (step_algo_finalize(algo) > 0) {
+            lib_collect_events(ctx, prev_count, (long)ctx->num_samp - 1, event_samp, event_type, max_events,
+                               &num_events);
+            if ((step_count != NULL) && (num_samp > 0))
+                step_count[num_samp - 1] = algo->out.step_count;
+        }
+    }
+
+    return num_events;
+
+}
+
+
+/* Process contiguous per axis arrays of the stream, block by block without a
+*  call per sample, the same as the per row loop of main() followed by
+*  step_algo_finalize if the stream ends with the arrays.
+*  Input: Context, arrays of AccX, AccY, AccZ, GyroX, GyroY, GyroZ (NULL if
+*         not available, AccY is required), timestamps in sec (or NULL for
+*         the 104 Hz sample clock), number of samples, per sample step_count
+*         and step_type outputs (or NULL; after finalize the last sample has
+*         the final values), finalize
+*  Output: Number of steps detected, -1 without AccY
+*/
+int step_algo_process_arrays(step_algo_ctx_t *ctx, const float *const axes[NUM_SENS_AXES], const float *timestamps,
+                             unsigned int num_samp, unsigned int *step_count, unsigned int *step_type, int finalize)
+{
+    step_algo_t   *algo = &ctx->algo;
+    unsigned int  first_count = algo->out.step_count;
+    unsigned int  prev_count, prev_type, pos, len, i, ax;
+    const float   *block[NUM_SENS_AXES];
+
+    if (axes[CHY] == NULL)
+        return -1;
+
+    for (pos = 0; pos < num_samp; pos += len) {
+        /* up to the end of the sensor input buffer, at most one algo run */
+        len = SAMP_BUFF_LEN - algo->AccBuffCount;
+        if (len > num_samp - pos)
+            len = num_samp - pos;
+        prev_count = algo->out.step_count;
+        prev_type = (unsigned int)algo->out.step_type;
+
+        for (ax = 0; ax < NUM_SENS_AXES; ax++)
+            block[ax] = (axes[ax] != NULL) ? axes[ax] + pos : NULL;
+        step_algo_push_arrays(algo, block, (timestamps != NULL) ? timestamps + pos : NULL, len,
+                              ctx->timestamp + SENSOR_SAMP_INTVL);
+        if (timestamps != NULL)
+            ctx->timestamp = timestamps[pos + len - 1];
+        else {
+            for (i = 0; i < len; i++)
+                ctx->timestamp += SENSOR_SAMP_INTVL;
+        }
+        ctx->num_samp += len;
+
+        for (i = pos; i < pos + len - 1; i++) {
+            if (step_count != NULL)
+                step_count[i] = prev_count;
+            if (step_type != NULL)
+                step_type[i] = prev_type;
+        }
+        if (step_count != NULL)
+            step_count[pos + len - 1] = algo->out.step_count;
+        if (step_type != NULL)
+            step_type[pos + len - 1] = (unsigned int)algo->out.step_type;
+    }
+
+    if ((finalize != 0) && (step_algo_finalize(algo) > 0)) {
+        if ((step_count != NULL) && (num_samp > 0))
+            step_count[num_samp - 1] = algo->out.step_count;
+        if ((step_type != NULL) && (num_samp > 0))
+            step_type[num_samp - 1] = (unsigned int)algo->out.step_type;
+    }
+
+    return (int)(algo->out.step_count - first_count);
+
+}
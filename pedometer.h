@@ -2,17 +2,125 @@
 #define __PEDOMETER_H__
 
 
+/* CPU sets and thread affinity of the NUMA worker placement */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <math.h>
+#include <complex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <float.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+/* AVX2 kernels are built with the target attribute and selected at run time */
+#if defined(__SSE2__) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STEP_ALGO_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#endif
+/* io_uring reader of the batch mode through raw system calls (no liburing) */
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && \
+    defined(__NR_io_uring_register)
+#define STEP_ALGO_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+/* Float evaluation modes. The default build is bit-exact for auditing: fixed */
+/* evaluation order, no FMA contraction, no reassociation and SIMD kernels    */
+/* only where they give the same result as the scalar code, so results match  */
+/* across compilers and CPUs (x86, ARM). Build with -DSTEP_ALGO_FAST_MATH     */
+/* (and e.g. -O3 -ffast-math -march=native) for the fast mode, which allows   */
+/* FMA, reassociation and approximate SIMD kernels; its deviation from the    */
+/* bit-exact mode is checked with --diff -t (see DIFF_FILTER_TOL).            */
+#if !defined(STEP_ALGO_FAST_MATH)
+#if defined(__FAST_MATH__)
+#error "-ffast-math needs the fast mode, build with -DSTEP_ALGO_FAST_MATH"
+#endif
+#if (FLT_EVAL_METHOD != 0)
+#error "The bit-exact mode needs float evaluation in float precision (FLT_EVAL_METHOD 0, e.g. -mfpmath=sse)"
+#endif
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+#endif
 
 #define EPSILON             (1E-6)
 
 #define SENSOR_SAMP_FREQ    ( 104 )
 #define SENSOR_SAMP_INTVL   ( 1.0f/SENSOR_SAMP_FREQ )
-#define BUFF_FACTOR         ( 2 )
+#ifndef BUFF_FACTOR
+#define BUFF_FACTOR         ( 2 )          /* Algo runs per sec, can be set at build time       */
+#endif
 #define SAMP_BUFF_LEN       ( SENSOR_SAMP_FREQ/BUFF_FACTOR )
 #define MAX_TC_SAMPLES      ( 20 )
+#define MAX_BLOCK_STEPS     ( 4 )          /* Step min samples kept per algo run                */
+#define MAX_CHAR_PER_LINE   ( 120 )
+#define FILTER_FLUSH_THRESHOLD    ( 1E-20f ) /* Filter outputs below are flushed to zero (no subnormals) */
+#define STREAM_FLUSH_TIMEOUT_SEC  ( 0.5f )  /* Flush partial buffer if stream stalls this long */
+#define STREAM_FLUSH_TIMEOUT_SAMP ( (unsigned int)(STREAM_FLUSH_TIMEOUT_SEC*SENSOR_SAMP_FREQ + 0.5f) )
+#define SESSION_MAX_GAP_SEC ( 2 )          /* Max TIME gap between rows of a continuous session */
+#define SESSION_MAX_FILL    ( 8 )          /* Max missing RECORDs filled by the last sample     */
+#define REPLAY_POLL_DIV     ( 4 )          /* Replay main loop wakeups per sample interval      */
+#define NUMA_MAX_NODES      ( 64 )         /* Max NUMA nodes of the worker placement            */
+#define GRAV_BASELINE_ALPHA ( 0.05f )      /* Per buffer update rate of the gravity baseline    */
+#define GRAV_BASELINE_UNINIT ( -1.0f )     /* Gravity baseline not yet estimated                */
+#define NUM_SENS_AXES       ( 2*NUM_DIM )  /* AccX, AccY, AccZ, GyroX, GyroY, GyroZ             */
+#define NUM_SPEC_BINS       ( 4 )          /* Spectral feature bins, 2, 4, 6, 8 Hz at 104 Hz    */
+#define FEAT_FILE_MAGIC     ( 0x46444550 ) /* "PEDF"                                            */
+#define FEAT_FILE_VERSION   ( 1 )
+#define MODEL_FEAT_PER_AXIS ( 6 + NUM_SPEC_BINS )  /* floats in axis_feat_t               */
+#define MODEL_NUM_FEATURES  ( 2 + MODEL_FEAT_PER_AXIS*NUM_SENS_AXES )
+
+/* Build with -DSTEP_ALGO_MIN_RAM for the minimal RAM profile (small wearables): */
+/* AccY input only, no gyro validation, features or model, timestamps derived   */
+/* from a sample tick counter and the derivative computed in place              */
+#if defined(STEP_ALGO_MIN_RAM)
+#define MAX_SOS_SECTIONS    ( 2 )          /* Max 2nd order sections of a cascaded filter       */
+#define STEP_ALGO_RAM_BUDGET ( 1024 )      /* Max bytes of one step_algo_t instance             */
+#define SAMPLE_RING_LEN     ( 32 )         /* Samples of the ISR handoff ring, power of 2       */
+#else
+#define MAX_SOS_SECTIONS    ( 8 )          /* Max 2nd order sections of a cascaded filter       */
+#define STEP_ALGO_RAM_BUDGET ( 8192 )      /* Max bytes of one step_algo_t instance             */
+#define SAMPLE_RING_LEN     ( 128 )        /* Samples of the ISR handoff ring, power of 2       */
+#endif
+
+/* Default per operation energy cost in pJ of the --energy model, see op_type_t */
+#define ENERGY_MAC_PJ       ( 4.0f )
+#define ENERGY_CMP_PJ       ( 1.0f )
+#define ENERGY_DIV_PJ       ( 20.0f )
+#define ENERGY_MEM_PJ       ( 6.0f )
+
+/* Default algorithm thresholds, see algo_cfg_t */
+#define VERY_HIGH_VAL          ( 100000 )
+#define NO_DETECT_DUR_SEC      ( 0.2f )    /* Duration to avoid very close peaks not related to step */
+#define CLOSE_TO_ZERO          ( 1.5f )    /* Threshold to detect if peak is reasonable height       */
+#define MAX_TIME_PERIOD_SEC    ( 1.5f )    /* Maximum time duration of one step                      */
+#define SMALL_AMP              ( 5.0f )    /* Lower threshold for change in accel during a step      */
+#define LARGE_AMP              ( 15.0f )   /* Higher threshold for change in accel during a step     */
+#define SLOW_FREQ              ( 0.5f )    /* Lower threshold for step rate during a step            */
+#define FAST_FREQ              ( 2.2f )    /* Lower threshold for step rate during a step            */
+#define GYRO_MIN_ENERGY        ( 0.02f )   /* Min filtered gyro energy (rad/s)^2 at a step peak      */
+#define GYRO_MAX_ENERGY        ( 40.0f )   /* Max filtered gyro energy (rad/s)^2 at a step peak      */
 
 /* Filter data struct for 2nd order filter */
 /* Y(n) = b0*X(n) + b1*X(n-1) + b2*X(n-2)  */
@@ -32,6 +140,45 @@ typedef struct {
     unsigned int TC_samples;
 } filter_t;
 
+/* Cascade of 2nd order sections, designed at init (see design_sos_filter)  */
+/* The coefficients b0, b1, b2, a1, a2 of all sections are stored back to  */
+/* back, state[s] holds X(n-1), X(n-2) of the input of section s, which is */
+/* also the output of section s-1; state[num_sect] holds the last outputs  */
+typedef struct {
+    unsigned int num_sect;
+    float        coef[MAX_SOS_SECTIONS][5];
+    float        state[MAX_SOS_SECTIONS + 1][2];
+} sos_filter_t;
+
+/* enum for cascaded filter types */
+typedef enum {
+    SOS_LOWPASS = 0,
+    SOS_BANDPASS
+} sos_type_t;
+
+/* Operation counting, build with -DSTEP_ALGO_OPCOUNT to count the operations */
+/* of the algorithm stages for the --energy model, no code otherwise           */
+typedef enum {
+    OPS_FILTER = 0,     /* apply_filter and the cascaded filter */
+    OPS_PREPROC,        /* step_algo_preproc, without filtering */
+    OPS_RUN,            /* step_algo_run, without filtering     */
+    NUM_OPS_STAGES
+} op_stage_t;
+
+typedef enum {
+    OPS_MAC = 0,        /* multiply, add, multiply-add */
+    OPS_CMP,            /* compare and branch          */
+    OPS_DIV,            /* divide and square root      */
+    OPS_MEM,            /* load and store              */
+    NUM_OPS_TYPES
+} op_type_t;
+
+#if defined(STEP_ALGO_OPCOUNT)
+#define OPS_COUNT(stage, op, n)   ( OpCount[stage][op] += (n) )
+#else
+#define OPS_COUNT(stage, op, n)
+#endif
+
 /* enum for motion types */
 typedef enum {
     STATIC = 0,
@@ -50,6 +197,26 @@ typedef enum {
 } axis_t;
 
 
+/* accelerometer channel fed to the algorithm */
+typedef enum {
+    INPUT_ACC_Y = 0,    /* AccY, sensor frame aligned with ground frame */
+    INPUT_ACC_MAG       /* |Acc| minus gravity, orientation independent */
+} input_mode_t;
+
+
+/* algorithm configuration (thresholds) data structure */
+typedef struct {
+    float          small_amp;
+    float          large_amp;
+    float          slow_freq;
+    float          fast_freq;
+    float          no_detect_dur;
+    float          close_to_zero;
+    float          max_time_period;
+    float          gyro_min_energy;
+    float          gyro_max_energy;
+} algo_cfg_t;
+
 /* algorithm output data structure */
 typedef struct {
     unsigned int   step_count;
@@ -58,15 +225,315 @@ typedef struct {
     float          prev_min;
     float          prev_max_ts;
     float          prev_min_ts;
+    float          prev_amp_est;
+    float          prev_freq_est;
+    unsigned int   amp_est_hold;
+    unsigned int   freq_est_hold;
+    unsigned int   type_steps[NUM_TYPES];
+    unsigned int   num_block_steps;                /* steps detected by the last algo run  */
+    unsigned int   block_step_samp[MAX_BLOCK_STEPS]; /* stream samples of their min values */
 } algo_out_t;
 
+/* sample format of a sensor FIFO burst */
+typedef enum {
+    FIFO_FLOAT = 0,     /* float, m/s^2 and rad/s */
+    FIFO_INT16          /* raw int16, scaled by acc_scale and gyro_scale */
+} fifo_fmt_t;
+
+/* layout of a sensor FIFO burst, samples are interleaved AccX, AccY, AccZ */
+/* followed by GyroX, GyroY, GyroZ if num_axes is 6                         */
+typedef struct {
+    fifo_fmt_t     fmt;
+    unsigned int   num_axes;               /* 3 (Acc only) or 6 (Acc and Gyro) */
+    float          acc_scale;              /* m/s^2 per LSB (FIFO_INT16) */
+    float          gyro_scale;             /* rad/s per LSB (FIFO_INT16) */
+} fifo_desc_t;
+
+/* single producer (sensor ISR), single consumer (main loop) sample ring  */
+/* head and tail are free running sample counters, the producer only     */
+/* writes head and the consumer only writes tail, so neither ever waits  */
+typedef struct {
+    float                 data[SAMPLE_RING_LEN][NUM_SENS_AXES];   /* AccX, AccY, AccZ, GyroX, GyroY, GyroZ */
+    atomic_uint           head;            /* samples written by the producer */
+    atomic_uint           tail;            /* samples consumed by the consumer */
+    unsigned int          overruns;        /* samples dropped, ring full (producer only) */
+} sample_ring_t;
+
+/* features of one axis over one block */
+typedef struct {
+    float          mean;
+    float          var;
+    float          energy;
+    float          min;
+    float          max;
+    float          zcr;                    /* mean crossings per sample */
+    float          spec[NUM_SPEC_BINS];    /* amplitude of spectral bins */
+} axis_feat_t;
+
+/* feature vector of one block, axes ordered AccX, AccY, AccZ, GyroX, GyroY, GyroZ */
+typedef struct {
+    float          timestamp;              /* timestamp of last sample of block */
+    unsigned int   num_samp;
+    unsigned int   step_count;
+    unsigned int   step_type;
+    float          amp_est;
+    float          freq_est;
+    axis_feat_t    axis[NUM_SENS_AXES];
+} block_feat_t;
+
+/* receives the feature vector of every algo run of an instance */
+typedef void (*feat_sink_t)(void *arg, const block_feat_t *feat);
+
+/* algorithm state of one sensor stream (instance), filters, sensor input */
+/* buffer, data carried from one run of step_algo_run to the next and the */
+/* algo output                                                            */
+typedef struct {
+    filter_t       lp_filter_y;            /* smoothens AccY (or |a|) */
+    filter_t       ll_filter_y;            /* derivative */
+    sos_filter_t   sos_filter_y;           /* replaces lp_filter_y if it has any sections */
+    algo_out_t     out;
+    unsigned int   AccBuffCount;           /* number of samples in the sensor input buffer */
+    float          prevAccDer;
+    float          AccBuffY[SAMP_BUFF_LEN];
+    float          AccFilt[SAMP_BUFF_LEN + MAX_TC_SAMPLES];
+    unsigned int   tick;                   /* samples since reset, in the minimal RAM profile sample n is at n*SENSOR_SAMP_INTVL sec */
+#if !defined(STEP_ALGO_MIN_RAM)
+    feat_sink_t    feat_sink;              /* block features (or NULL), set by the owner, kept by step_algo_reset */
+    void           *feat_arg;
+    filter_t       lp_filter_g;            /* gyro energy */
+    float          GravBaseline;           /* gravity baseline of the magnitude channel */
+    float          AccBuffX[SAMP_BUFF_LEN];
+    float          AccBuffZ[SAMP_BUFF_LEN];
+    float          AccBuffTs[SAMP_BUFF_LEN];
+    float          GyroBuff[SAMP_BUFF_LEN];
+    float          RawBuff[NUM_SENS_AXES][SAMP_BUFF_LEN];
+    float          TimeStamps[SAMP_BUFF_LEN + MAX_TC_SAMPLES];
+    float          GyroFilt[SAMP_BUFF_LEN + MAX_TC_SAMPLES];
+    float          AccDer[SAMP_BUFF_LEN];  /* Derivative of Accel Data */
+#endif
+} step_algo_t;
+
+_Static_assert(sizeof(step_algo_t) <= STEP_ALGO_RAM_BUDGET, "step_algo_t exceeds STEP_ALGO_RAM_BUDGET");
+
+/* one sensor stream of the library interface (step_algo_create) */
+typedef struct {
+    step_algo_t    algo;
+    float          timestamp;              /* of the last sample, sec */
+    unsigned long  num_samp;               /* samples processed */
+    block_feat_t   *feat;                  /* block feature output (step_algo_feat_output) */
+    unsigned int   max_feat, num_feat;
+} step_algo_ctx_t;
+
+/* NUMA nodes with CPUs the process may run on (see numa_init) */
+typedef struct {
+    unsigned int   num_nodes;
+    int            node_id[NUMA_MAX_NODES];    /* kernel node number, -1 if unknown */
+    unsigned int   num_cpus[NUMA_MAX_NODES];
+#if defined(__linux__)
+    cpu_set_t      cpus[NUMA_MAX_NODES];
+#endif
+} numa_topo_t;
+
+/* SIMD kernel variant, selected once at start up (--simd) */
+typedef struct {
+    const char     *name;
+    unsigned int   (*find_zc)(const float *AccDer, float prevAccDer, unsigned int len, unsigned int *zc_idx);
+    void           (*acc_magnitude)(const float *arx, const float *ary, const float *arz, float *mag, unsigned int len);
+#if !defined(STEP_ALGO_MIN_RAM)
+    void           (*axis_features)(const float *data, unsigned int len, axis_feat_t *feat);
+#endif
+} simd_kernels_t;
+
+
+/* one row of the sensor input file */
+typedef struct {
+    unsigned int   rec_id;
+    unsigned int   sen_id;
+    char           date[12];
+    char           time[12];
+    float          arx, ary, arz; /* m/s^2 */
+    float          grx, gry, grz; /* rad/s */
+} sens_data_t;
+
 
 /* Function prototypes */
 static float apply_filter(filter_t *filt_data, float in_data);
 
-static unsigned int step_algo_preproc(float timestamp, float arx, float ary, float arz, float grx, float gry, float grz);
+static int design_sos_filter(sos_filter_t *filt_data, sos_type_t type, unsigned int order, float f1, float f2);
+
+static void reset_sos_filter(sos_filter_t *filt_data);
+
+static void apply_sos_filter_block(sos_filter_t *filt_data, const float *in_data, float *out_data, unsigned int len);
+
+static void lp_filter_block(filter_t *filt_data, sos_filter_t *sos_data, float *data, unsigned int len);
+
+static int parse_filter_opt(const char *opt, sos_filter_t *filt_data);
+
+static void acc_mag_preproc(float *baseline, const float *arx, float *ary, const float *arz, unsigned int len);
+
+static void acc_magnitude(const float *arx, const float *ary, const float *arz, float *mag, unsigned int len);
+
+static void acc_magnitude_scalar(const float *arx, const float *ary, const float *arz, float *mag, unsigned int len);
+
+#if defined(__SSE2__)
+static void acc_magnitude_sse2(const float *arx, const float *ary, const float *arz, float *mag, unsigned int len);
+#endif
+
+#if defined(STEP_ALGO_AVX2)
+static void acc_magnitude_avx2(const float *arx, const float *ary, const float *arz, float *mag, unsigned int len);
+#endif
+
+#if !defined(STEP_ALGO_MIN_RAM)
+static void init_spec_tables(void);
+
+static void extract_block_features(float raw[NUM_SENS_AXES][SAMP_BUFF_LEN], unsigned int len, block_feat_t *feat);
+
+static void extract_axis_features_scalar(const float *data, unsigned int len, axis_feat_t *feat);
+
+#if defined(__SSE2__) && defined(STEP_ALGO_FAST_MATH)
+static float hsum_sse2(__m128 v);
+
+static void extract_axis_features_sse2(const float *data, unsigned int len, axis_feat_t *feat);
+#endif
+
+static void write_feat_header(FILE *fpfeat);
+
+static void write_feat_record(void *arg, const block_feat_t *feat);
+#endif
+
+static void init_lp_filter(filter_t *filt_data);
+
+static void init_ll_filter(filter_t *filt_data);
+
+static void init_algo_out(algo_out_t *step_algo_output);
+
+static void step_algo_reset(step_algo_t *algo);
+
+static void write_out_header(FILE *fpout);
+
+static void write_out_data(FILE *fpout, const sens_data_t *sens_data, float timestamp, const algo_out_t *step_algo_output);
+
+static void print_summary(float duration, const algo_out_t *step_algo_output);
+
+static int session_process(FILE *fpout, char *files[], int num_files, step_algo_t *algo, float *timestamp,
+                           unsigned int *num_segments, unsigned int *num_filled);
+
+static int sens_data_gap(const sens_data_t *prev_data, const sens_data_t *sens_data);
+
+static int read_sens_data(FILE *fpin, sens_data_t *sens_data);
+
+static void parse_sens_data(const char *line_buff, sens_data_t *sens_data);
+
+static int skip_header(FILE *fpin);
+
+static unsigned int step_algo_preproc(step_algo_t *algo, float timestamp, float arx, float ary, float arz, float grx, float gry, float grz);
+
+static unsigned int step_algo_push(step_algo_t *algo, const fifo_desc_t *desc, const void *fifo, unsigned int num_samp, float timestamp);
+
+static unsigned int step_algo_push_arrays(step_algo_t *algo, const float *const axes[NUM_SENS_AXES], const float *timestamps,
+                                          unsigned int num_samp, float timestamp);
+
+static unsigned int step_algo_preproc_block(step_algo_t *algo, unsigned int n, unsigned int len);
+
+static void fifo_deinterleave(const fifo_desc_t *desc, const void *fifo, unsigned int axis, unsigned int len, float *out);
+
+static void array_copy(float *out, const float *in, unsigned int pos, unsigned int len);
+
+static void sample_ring_init(sample_ring_t *ring);
+
+static int sample_ring_put(sample_ring_t *ring, float arx, float ary, float arz, float grx, float gry, float grz);
+
+static unsigned int sample_ring_drain(sample_ring_t *ring, step_algo_t *algo, float *timestamp);
+
+static void step_algo_run(step_algo_t *algo);
+
+static void step_algo_run_block(step_algo_t *algo, unsigned int num_samp);
+
+static unsigned int step_algo_finalize(step_algo_t *algo);
+
+static unsigned int step_algo_poll(step_algo_t *algo, unsigned int now_tick);
+
+static unsigned int step_algo_find_zc(const float *AccDer, float prevAccDer, unsigned int len, unsigned int *zc_idx);
+
+static unsigned int step_algo_find_zc_scalar(const float *AccDer, float prevAccDer, unsigned int len, unsigned int *zc_idx);
+
+#if defined(__SSE2__)
+static unsigned int step_algo_find_zc_sse2(const float *AccDer, float prevAccDer, unsigned int len, unsigned int *zc_idx);
+#endif
+
+#if defined(STEP_ALGO_AVX2)
+static unsigned int step_algo_find_zc_avx2(const float *AccDer, float prevAccDer, unsigned int len, unsigned int *zc_idx);
+#endif
+
+static int simd_select(const char *name);
+
+static void numa_init(numa_topo_t *topo);
+
+static int numa_worker_node(unsigned int t);
+
+static void numa_pin(int node);
+
+static void *numa_alloc(size_t size, int node);
+
+static void numa_free(void *ptr, size_t size);
+
+static unsigned int step_algo_detect(const algo_cfg_t *cfg, algo_out_t *step_algo_output, const float *AccDer,
+                                     const float *AccFilt, const float *TimeStamps, float ts0, const float *GyroFilt,
+                                     const unsigned int *zc_idx, unsigned int num_zc, block_feat_t *feat);
+
+static motion_type_t classify_motion(const algo_cfg_t *cfg, float amp_est, float freq_est);
+
+static motion_type_t classify_motion_model(const block_feat_t *feat);
+
+static void model_features(const block_feat_t *feat, float *x);
+
+static int run_sweep(int argc, char *argv[]);
+
+static int run_session(int argc, char *argv[]);
+
+static int run_compile_model(int argc, char *argv[]);
+
+static int run_bench(int argc, char *argv[]);
+
+static int run_footprint(void);
+
+static int run_energy(int argc, char *argv[]);
+
+static int run_replay(int argc, char *argv[]);
+
+static int run_load(int argc, char *argv[]);
+
+static int run_diff(int argc, char *argv[]);
+
+static int run_batch(int argc, char *argv[]);
+
+static int run_merge(int argc, char *argv[]);
+
+
+/* Library interface, exported by the shared library build */
+int step_algo_configure(const char *simd, const char *filter, int magnitude, int gyro);
+
+step_algo_ctx_t *step_algo_create(void);
+
+void step_algo_destroy(step_algo_ctx_t *ctx);
+
+void step_algo_ctx_reset(step_algo_ctx_t *ctx);
+
+unsigned int step_algo_steps(const step_algo_ctx_t *ctx, unsigned int type);
+
+int step_algo_feat_output(step_algo_ctx_t *ctx, block_feat_t *feat, unsigned int max_feat);
+
+unsigned int step_algo_num_feat(const step_algo_ctx_t *ctx);
+
+unsigned int step_algo_feat_layout(unsigned int *block_len, unsigned int *num_spec_bins);
+
+unsigned int step_algo_process(step_algo_ctx_t *ctx, const float *samples, unsigned int num_axes,
+                               unsigned int num_samp, unsigned int *step_count,
+                               unsigned int *event_samp, unsigned int *event_type, unsigned int max_events,
+                               int finalize);
 
-static void step_algo_run(algo_out_t *step_algo_output);
+int step_algo_process_arrays(step_algo_ctx_t *ctx, const float *const axes[NUM_SENS_AXES], const float *timestamps,
+                             unsigned int num_samp, unsigned int *step_count, unsigned int *step_type, int finalize);
 
 
 #endif /* __PEDOMETER_H__ */
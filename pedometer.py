@@ -0,0 +1,200 @@
+"""
+  Filename: pedometer.py
+  Topic:  Python bindings of the Step Detect and Count Algorithm
+
+  Runs the algorithm of pedometer.c in process over NumPy arrays through the
+  library interface of the shared library, build it with
+    gcc -Wall -O2 -shared -fPIC -o libpedometer.so pedometer.c -lm -pthread
+  The library is loaded from PEDOMETER_LIB or from libpedometer.so next to
+  this file.
+
+  C-contiguous float32 arrays are passed to the library without a copy (other
+  arrays are converted once), and the GIL is released while the library runs
+  over the whole array, so streams can be processed concurrently from threads.
+
+  Example:
+    import numpy as np, pedometer
+    data = np.loadtxt('SensData_walk_run_stripped.csv', delimiter=',', skiprows=2,
+                      usecols=range(4, 10), dtype=np.float32)
+    ped = pedometer.Pedometer()
+    res = ped.process(data)            # (n, 6) AccX..GyroZ, (n, 3) Acc or (n,) AccY
+    print(res.step_count[-1], ped.totals())
+    res = ped.process_axes(ary, timestamps=ts)   # one array per axis, any of them optional but AccY
+    res = ped.process(data, features=True)         # res.features: structured array, one row per block
+"""
+
+import collections
+import ctypes
+import os
+
+import numpy as np
+
+
+# Motion types, see motion_type_t
+STATIC, WALK, HOP, RUN = range(4)
+MOTION_TYPES = ('STATIONARY', 'WALKING', 'HOPPING', 'RUNNING')
+
+StepResult = collections.namedtuple('StepResult', ['step_count', 'event_sample', 'event_type', 'features'],
+                                    defaults=(None,))
+AxesResult = collections.namedtuple('AxesResult', ['step_count', 'step_type', 'features'], defaults=(None,))
+
+_lib = None
+
+
+def _load():
+    global _lib
+    if _lib is None:
+        path = os.environ.get('PEDOMETER_LIB',
+                              os.path.join(os.path.dirname(os.path.abspath(__file__)), 'libpedometer.so'))
+        # ctypes.CDLL releases the GIL during every call
+        lib = ctypes.CDLL(path)
+        u32p = ctypes.POINTER(ctypes.c_uint)
+        lib.step_algo_configure.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int, ctypes.c_int]
+        lib.step_algo_configure.restype = ctypes.c_int
+        lib.step_algo_create.argtypes = []
+        lib.step_algo_create.restype = ctypes.c_void_p
+        lib.step_algo_destroy.argtypes = [ctypes.c_void_p]
+        lib.step_algo_destroy.restype = None
+        lib.step_algo_ctx_reset.argtypes = [ctypes.c_void_p]
+        lib.step_algo_ctx_reset.restype = None
+        lib.step_algo_steps.argtypes = [ctypes.c_void_p, ctypes.c_uint]
+        lib.step_algo_steps.restype = ctypes.c_uint
+        lib.step_algo_process.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_float), ctypes.c_uint,
+                                          ctypes.c_uint, u32p, u32p, u32p, ctypes.c_uint, ctypes.c_int]
+        lib.step_algo_process.restype = ctypes.c_uint
+        lib.step_algo_process_arrays.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_void_p),
+                                                 ctypes.c_void_p, ctypes.c_uint, u32p, u32p, ctypes.c_int]
+        lib.step_algo_process_arrays.restype = ctypes.c_int
+        lib.step_algo_feat_output.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_uint]
+        lib.step_algo_feat_output.restype = ctypes.c_int
+        lib.step_algo_num_feat.argtypes = [ctypes.c_void_p]
+        lib.step_algo_num_feat.restype = ctypes.c_uint
+        lib.step_algo_feat_layout.argtypes = [u32p, u32p]
+        lib.step_algo_feat_layout.restype = ctypes.c_uint
+        _lib = lib
+    return _lib
+
+
+def _u32p(a):
+    return a.ctypes.data_as(ctypes.POINTER(ctypes.c_uint))
+
+
+def _feat_dtype(num_spec_bins):
+    """NumPy dtype of block_feat_t, axes AccX, AccY, AccZ, GyroX, GyroY, GyroZ."""
+    axis = np.dtype([('mean', np.float32), ('var', np.float32), ('energy', np.float32), ('min', np.float32),
+                     ('max', np.float32), ('zcr', np.float32), ('spec', np.float32, (num_spec_bins,))])
+    return np.dtype([('timestamp', np.float32), ('num_samp', np.uint32), ('step_count', np.uint32),
+                     ('step_type', np.uint32), ('amp_est', np.float32), ('freq_est', np.float32),
+                     ('axis', axis, (6,))])
+
+
+def configure(simd='auto', filter=None, magnitude=False, gyro=False):
+    """Set the preprocessing options of all streams (--simd, --filter,
+    --magnitude, --gyro of the CLI), before creating any Pedometer."""
+    lib = _load()
+    if lib.step_algo_configure(simd.encode(), None if filter is None else filter.encode(),
+                               int(magnitude), int(gyro)) != 0:
+        raise ValueError('invalid or unavailable option')
+
+
+class Pedometer(object):
+    """One sensor stream, successive process() calls continue the stream."""
+
+    def __init__(self):
+        self._lib = _load()
+        self._ctx = self._lib.step_algo_create()
+        if not self._ctx:
+            raise MemoryError('cannot create pedometer context')
+
+    def close(self):
+        if self._ctx:
+            self._lib.step_algo_destroy(self._ctx)
+            self._ctx = None
+
+    def __del__(self):
+        self.close()
+
+    def reset(self):
+        """Start a new stream, the step totals are cleared."""
+        self._lib.step_algo_ctx_reset(self._ctx)
+
+    def totals(self):
+        """Steps so far, in total and per motion type."""
+        res = {'total': self._lib.step_algo_steps(self._ctx, len(MOTION_TYPES))}
+        for t, name in enumerate(MOTION_TYPES):
+            res[name] = self._lib.step_algo_steps(self._ctx, t)
+        return res
+
+    def _run(self, call, num_samp, features):
+        """Run call() on the context, with features collect the block features
+        of its algo runs."""
+        if not features:
+            call()
+            return None
+        block_len, num_bins = ctypes.c_uint(), ctypes.c_uint()
+        size = self._lib.step_algo_feat_layout(ctypes.byref(block_len), ctypes.byref(num_bins))
+        dtype = _feat_dtype(num_bins.value)
+        if size == 0 or dtype.itemsize != size:
+            raise ValueError('block features are not available in this library build')
+        # one run per complete block (the buffered samples included) and the finalize
+        feats = np.zeros(num_samp // block_len.value + 2, dtype=dtype)
+        self._lib.step_algo_feat_output(self._ctx, feats.ctypes.data, len(feats))
+        try:
+            call()
+            num_feat = self._lib.step_algo_num_feat(self._ctx)
+        finally:
+            self._lib.step_algo_feat_output(self._ctx, None, 0)
+        return feats[:num_feat]
+
+    def process(self, samples, finalize=True, features=False):
+        """Process samples at 104 Hz: an (n,) array of AccY or an (n, 3) or
+        (n, 6) array of AccX, AccY, AccZ[, GyroX, GyroY, GyroZ] in m/s^2 and
+        rad/s. With finalize the trailing samples that do not fill a complete
+        algorithm buffer are processed as well (end of stream).
+        Returns the step_count after every sample and per step event the
+        sample index within the stream and the motion type, with features
+        also the feature vector of every algo run (block)."""
+        data = np.ascontiguousarray(samples, dtype=np.float32)
+        if data.ndim == 1:
+            num_axes = 1
+        elif data.ndim == 2 and data.shape[1] in (3, 6):
+            num_axes = data.shape[1]
+        else:
+            raise ValueError('samples must have the shape (n,), (n, 3) or (n, 6)')
+        num_samp = data.shape[0]
+        step_count = np.empty(num_samp, dtype=np.uint32)
+        # every step is at a derivative zero crossing of a sample processed by
+        # this call, the new samples or the up to SAMP_BUFF_LEN (<= 104)
+        # buffered ones, so the events cannot overflow the buffers
+        max_events = num_samp + 104
+        event_sample = np.empty(max_events, dtype=np.uint32)
+        event_type = np.empty(max_events, dtype=np.uint32)
+        num_events = [0]
+
+        def call():
+            num_events[0] = self._lib.step_algo_process(self._ctx, data.ctypes.data_as(ctypes.POINTER(ctypes.c_float)),
+                                                        num_axes, num_samp, _u32p(step_count), _u32p(event_sample),
+                                                        _u32p(event_type), max_events, int(finalize))
+        feats = self._run(call, num_samp, features)
+        return StepResult(step_count, event_sample[:num_events[0]], event_type[:num_events[0]], feats)
+
+    def process_axes(self, ary, arx=None, arz=None, grx=None, gry=None, grz=None, timestamps=None,
+                     finalize=True, features=False):
+        """Process one array per axis (m/s^2 and rad/s), missing axes are zero,
+        with optional timestamps in sec (default the 104 Hz sample clock).
+        Returns the step_count and step_type after every sample, with features
+        also the feature vector of every algo run (block)."""
+        arrays = [None if a is None else np.ascontiguousarray(a, dtype=np.float32)
+                  for a in (arx, ary, arz, grx, gry, grz, timestamps)]
+        num_samp = arrays[1].shape[0]
+        for a in arrays:
+            if a is not None and a.shape != (num_samp,):
+                raise ValueError('all arrays must have the shape (n,)')
+        axes = (ctypes.c_void_p * 6)(*[None if a is None else a.ctypes.data for a in arrays[:6]])
+        step_count = np.empty(num_samp, dtype=np.uint32)
+        step_type = np.empty(num_samp, dtype=np.uint32)
+        def call():
+            self._lib.step_algo_process_arrays(self._ctx, axes, None if arrays[6] is None else arrays[6].ctypes.data,
+                                               num_samp, _u32p(step_count), _u32p(step_type), int(finalize))
+        feats = self._run(call, num_samp, features)
+        return AxesResult(step_count, step_type, feats)